@@ -1,14 +1,57 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L  /* clock_gettime(), pthread_create(), mmap(), fdopen() */
+#endif
+#define ZSON_IMPLEMENTATION      /* the accessors are defined here, not inlined from Zson.h */
 #ifdef _WINDOWS
 #define _CRTDBG_MAP_ALLOC
 #include <crtdbg.h>
 #endif
-#include "zson.h"
+#include "Zson.h"
 #include <assert.h>  /* assert() */
 #include <errno.h>   /* errno, ERANGE */
+#include <limits.h>  /* INT_MIN, INT_MAX */
 #include <math.h>    /* HUGE_VAL */
 #include <stdio.h>   /* sprintf() */
 #include <stdlib.h>  /* NULL, malloc(), realloc(), free(), strtod() */
 #include <string.h>  /* memcpy() */
+#ifdef ZSON_TRACE
+#include <time.h>    /* clock_gettime(), clock() */
+#endif
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#include <fcntl.h>    /* open() */
+#include <sys/mman.h> /* mmap(), posix_madvise() */
+#include <sys/stat.h> /* fstat() */
+#include <unistd.h>   /* sysconf(), close() */
+#if defined(POSIX_MADV_SEQUENTIAL)  /* missing when a system header came before _POSIX_C_SOURCE */
+#define ZSON_MMAP
+#endif
+#endif
+#if defined(_WIN32)
+#include <windows.h> /* CreateThread(), SwitchToThread() */
+#elif defined(ZSON_THREADS)
+#include <pthread.h> /* pthread_create() */
+#endif
+#if !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#define ZSON_SCHED_YIELD
+#include <sched.h>   /* sched_yield() */
+#endif
+
+#if !defined(ZSON_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define ZSON_SSE2
+#include <emmintrin.h> /* _mm_loadu_si128(), _mm_cmpeq_epi8(), _mm_movemask_epi8() */
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>    /* _BitScanForward(), _InterlockedIncrement() */
+#endif
+/* scans of NUL-terminated input read whole aligned blocks, which address sanitizers report */
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define ZSON_ASAN
+#endif
+#endif
+#if defined(ZSON_SSE2) && !defined(__SANITIZE_ADDRESS__) && !defined(ZSON_ASAN)
+#define ZSON_SSE2_OVERREAD
+#endif
 
 #ifndef ZSON_PARSE_STACK_INIT_SIZE
 #define ZSON_PARSE_STACK_INIT_SIZE 256
@@ -18,27 +61,380 @@
 #define ZSON_PARSE_STRINGIFY_INIT_SIZE 256
 #endif
 
+#ifndef ZSON_PARSE_MAX_DEPTH
+#define ZSON_PARSE_MAX_DEPTH 1024
+#endif
+
+#ifndef ZSON_WALK_LOCAL_DEPTH
+#define ZSON_WALK_LOCAL_DEPTH 32  /* tree walks only allocate below this depth */
+#endif
+
+#define ZSON_INT64        0x1  /* number is stored in u.i */
+#define ZSON_UINT64       0x2  /* number is stored in u.ui, only used above ZSON_INT64_MAX */
+#define ZSON_INTEGER      (ZSON_INT64 | ZSON_UINT64)
+#define ZSON_FROZEN       0x4  /* container is read-only, object members are sorted by key */
+#define ZSON_PACKED_DOUBLE 0x8 /* array elements are stored as double[] */
+#define ZSON_PACKED_INT64 0x10 /* array elements are stored as zson_int64[] */
+#define ZSON_PACKED       (ZSON_PACKED_DOUBLE | ZSON_PACKED_INT64)
+#define ZSON_COMPACT      0x20 /* string or container data lives in an arena of zson_compact() */
+
+#define ZSON_UINT64_MAX   ((zson_uint64)-1)
+#define ZSON_INT64_MAX    ((zson_int64)(ZSON_UINT64_MAX >> 1))
+#define ZSON_INT64_MIN    (-ZSON_INT64_MAX - 1)
+
+/*
+ * Writers of the fields behind ZSON_TYPE_OF() and friends. ZSON_SET_TYPE() drops the flags and the data
+ * pointer, so it comes first; numbers are only written through the ZSON_SET_<number>() ones.
+ */
+#ifdef ZSON_SMALL_VALUES
+#define ZSON_BOX_INT64      ((zson_uint64)1 << 63)  /* ZSON_INT64 */
+#define ZSON_BOX_WIDE       ((zson_uint64)1 << 51)  /* ZSON_UINT64 of numbers, ZSON_COMPACT of the others */
+#define ZSON_BOX_LOW        ((zson_uint64)7)        /* ZSON_FROZEN and ZSON_PACKED, shifted down by 2 */
+#define ZSON_BOX(t)         (ZSON_BOX_EXPONENT | (zson_uint64)((t) + 1) << 48)
+#define ZSON_SET_TYPE(v, t) ((v)->w.tag = ZSON_BOX(t))
+#define ZSON_FLAGS_OF(v)    zson_box_flags(v)
+#define ZSON_SET_FLAGS(v, f) zson_box_set_flags(v, f)
+#define ZSON_SET_DATA(v, p) zson_box_set_data(v, p)
+#define ZSON_SET_DOUBLE(v, d) zson_box_set_double(v, d)
+#define ZSON_SET_INT64(v, n) ((v)->u.i = (n), (v)->w.tag = ZSON_BOX(ZSON_NUMBER) | ZSON_BOX_INT64)
+#define ZSON_SET_UINT64(v, n) ((v)->u.ui = (n), (v)->w.tag = ZSON_BOX(ZSON_NUMBER) | ZSON_BOX_WIDE)
+
+static unsigned zson_box_flags(const zson_value* v) {
+    unsigned flags;
+    if (!ZSON_BOXED(v))
+        return 0;
+    flags = (unsigned)(v->w.tag & ZSON_BOX_LOW) << 2;
+    if (v->w.tag & ZSON_BOX_INT64)
+        flags |= ZSON_INT64;
+    if (v->w.tag & ZSON_BOX_WIDE)
+        flags |= ZSON_TYPE_OF(v) == ZSON_NUMBER ? ZSON_UINT64 : ZSON_COMPACT;
+    return flags;
+}
+
+static void zson_box_set_flags(zson_value* v, unsigned flags) {
+    zson_uint64 tag = v->w.tag & ~(ZSON_BOX_INT64 | ZSON_BOX_WIDE | ZSON_BOX_LOW);
+    assert(ZSON_BOXED(v));
+    tag |= (flags >> 2) & ZSON_BOX_LOW;
+    if (flags & ZSON_INT64)
+        tag |= ZSON_BOX_INT64;
+    if (flags & (ZSON_UINT64 | ZSON_COMPACT))
+        tag |= ZSON_BOX_WIDE;
+    v->w.tag = tag;
+}
+
+static void zson_box_set_data(zson_value* v, const void* p) {
+    assert(ZSON_BOXED(v) && ((zson_uint64)(size_t)p & ~ZSON_BOX_POINTER) == 0);
+    v->w.tag = (v->w.tag & ~ZSON_BOX_POINTER) | (zson_uint64)(size_t)p;
+}
+
+/* NaNs that look like a boxed value become the canonical one. */
+static void zson_box_set_double(zson_value* v, double d) {
+    v->w.n = d;
+    if (ZSON_BOXED(v))
+        v->w.tag = ZSON_BOX_EXPONENT | ZSON_BOX_WIDE;
+}
+#else
+#define ZSON_SET_TYPE(v, t) ((v)->type = (t), (v)->flags = 0)
+#define ZSON_FLAGS_OF(v)    ((v)->flags)
+#define ZSON_SET_FLAGS(v, f) ((v)->flags = (f))
+#define ZSON_SET_DATA(v, p) ((v)->u.s.s = (char*)(p))
+#define ZSON_SET_DOUBLE(v, d) ((v)->u.n = (d), (v)->type = ZSON_NUMBER, (v)->flags = 0)
+#define ZSON_SET_INT64(v, n) ((v)->u.i = (n), (v)->type = ZSON_NUMBER, (v)->flags = ZSON_INT64)
+#define ZSON_SET_UINT64(v, n) ((v)->u.ui = (n), (v)->type = ZSON_NUMBER, (v)->flags = ZSON_UINT64)
+#endif
+
 #define EXPECT(c, ch)       do { assert(*c->json == (ch)); c->json++; } while(0)
 #define ISDIGIT(ch)         ((ch) >= '0' && (ch) <= '9')
 #define ISDIGIT1TO9(ch)     ((ch) >= '1' && (ch) <= '9')
 #define PUTC(c, ch)         do { *(char*)zson_context_push(c, sizeof(char)) = (ch); } while(0)
 #define PUTS(c, s, len)     memcpy(zson_context_push(c, len), s, len)
 
+#if defined(_MSC_VER)
+#define ZSON_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#define ZSON_THREAD_LOCAL __thread
+#else
+#define ZSON_THREAD_LOCAL  /* no thread-local storage, counters are shared */
+#endif
+
+#ifdef ZSON_STATS
+static ZSON_THREAD_LOCAL zson_stats zson_thread_stats;
+#define ZSON_STAT(field, n)         (zson_thread_stats.field += (n))
+#else
+#define ZSON_STAT(field, n)         ((void)(n))
+#endif
+
+#ifdef ZSON_TRACE
+typedef double zson_trace_mark;
+static void zson_trace_begin(zson_trace_kind kind, zson_trace_mark* mark);
+static void zson_trace_end(zson_trace_kind kind, zson_trace_mark mark, size_t bytes);
+static ZSON_THREAD_LOCAL zson_trace zson_thread_trace;
+#define ZSON_TRACE_DECL(m)          zson_trace_mark m;
+#define ZSON_TRACE_BEGIN(k, m)      zson_trace_begin(k, &(m))
+#define ZSON_TRACE_END(k, m, bytes) zson_trace_end(k, m, bytes)
+#define ZSON_TRACE_COUNT(field)     (zson_thread_trace.field++)
+#else
+#define ZSON_TRACE_DECL(m)
+#define ZSON_TRACE_BEGIN(k, m)      ((void)0)
+#define ZSON_TRACE_END(k, m, bytes) ((void)(bytes))
+#define ZSON_TRACE_COUNT(field)     ((void)0)
+#endif
+
+#define ZSON_ALLOC(a, size)         (ZSON_STAT(allocs, 1), (a)->allocate((a)->ctx, (size)))
+#define ZSON_REALLOC(a, ptr, size)  (ZSON_STAT(reallocs, 1), (a)->reallocate((a)->ctx, (ptr), (size)))
+#define ZSON_DEALLOC(a, ptr)        ((a)->deallocate((a)->ctx, (ptr)))
+
 typedef struct {
     const char* json;
     char* stack;
     size_t size, top;
+    char* local;                 /* caller-owned initial stack, never freed */
+    const zson_allocator* a;     /* allocator of the stack */
+    const zson_allocator* va;    /* allocator of the values being parsed */
+    size_t max_depth;            /* container nesting limit */
+    const zson_projection* proj; /* projection of the value being parsed, NULL keeps everything */
+    const zson_schema* schema;   /* schema of the value being parsed, NULL accepts everything */
+    unsigned flags;              /* ZSON_PARSE_* or ZSON_STRINGIFY_* */
 }zson_context;
 
+/* Parse frame of an open container, its elements or members are pushed above it. */
+typedef struct {
+    size_t prev;                 /* stack offset of the enclosing frame */
+    size_t slot;                 /* stack offset of the value being built */
+    size_t size;                 /* elements or members pushed so far */
+    const zson_projection* proj; /* projection of the members */
+    const zson_schema* schema;   /* schema of the container */
+    zson_type type;              /* ZSON_ARRAY or ZSON_OBJECT */
+#ifdef ZSON_TRACE
+    const char* json;            /* opening bracket */
+    zson_trace_mark mark;
+#endif
+}zson_parse_frame;
+
+#define ZSON_ROOT ((size_t)-1)   /* no enclosing frame, the slot is the root value */
+
+/* Frame of a container visited by a tree walk. */
+typedef struct {
+    const zson_value* v;         /* container being walked */
+    const zson_value* w;         /* its counterpart in zson_is_equal() */
+    size_t i;                    /* index of the next child */
+#ifdef ZSON_TRACE
+    size_t head;                 /* output offset of the container in zson_stringify_value() */
+    zson_trace_mark mark;
+#endif
+}zson_walk_frame;
+
+#define WALK_TOP(s)         ((zson_walk_frame*)((s)->stack + (s)->top) - 1)
+#define WALK_SIZE(v)        (ZSON_TYPE_OF(v) == ZSON_ARRAY ? (v)->u.a.size : (v)->u.o.size)
+#define WALK_DATA(v)        ZSON_DATA_OF(v)
+#define PACKED_DOUBLES(v)   ((double*)ZSON_DATA_OF(v))
+#define PACKED_INT64S(v)    ((zson_int64*)ZSON_DATA_OF(v))
+
+/*
+ * Strings, elements and members live in blocks with a reference count in front, so zson_copy_shared()
+ * only shares the block. Mutators copy a shared block before they touch it (copy-on-write). The count is
+ * only changed atomically while the block is shared: a count of 1 means nobody else can see it.
+ * In front of the count is the allocator the block came from, which also allocated the keys of the
+ * members in it, so a value parsed with a per-call allocator grows and shrinks with that one.
+ */
+typedef union {
+    long refs;                   /* owners of the block */
+    size_t n;                    /* capacity of a container, see ZSON_SMALL_VALUES */
+    const zson_allocator* a;     /* allocator of the block */
+    double d; void* p;           /* alignment of the data that follows */
+}zson_block;
+
+#define ZSON_BLOCK(data)    ((zson_block*)(data) - 1)
+#define ZSON_OWNER(data)    (((zson_block*)(data) - 2)->a)
+#define ZSON_ARENA(data)    (((zson_block*)(data) - 2)->p)  /* arena holding a ZSON_COMPACT block instead */
+
+/* With ZSON_SMALL_VALUES every block but the compacted ones starts with a third header, the capacity. */
+#ifdef ZSON_SMALL_VALUES
+#define ZSON_BLOCK_HEADER   3
+#define ZSON_CAPACITY(v)    (WALK_DATA(v) == NULL ? 0 : ZSON_FLAGS_OF(v) & ZSON_COMPACT ? WALK_SIZE(v) : ((zson_block*)WALK_DATA(v) - 3)->n)
+#else
+#define ZSON_BLOCK_HEADER   2
+#define ZSON_CAPACITY(v)    (ZSON_TYPE_OF(v) == ZSON_ARRAY ? (v)->u.a.capacity : (v)->u.o.capacity)
+#endif
+
+#if defined(__GNUC__)
+#define ZSON_ATOMIC_INC(p)  __sync_add_and_fetch(p, 1)
+#define ZSON_ATOMIC_DEC(p)  __sync_sub_and_fetch(p, 1)
+#define ZSON_ATOMIC_LOAD(p) __sync_add_and_fetch(p, 0)
+#define ZSON_ATOMIC_CAS_PTR(p, o, n) __sync_val_compare_and_swap(p, o, n)
+#elif defined(_MSC_VER)
+#define ZSON_ATOMIC_INC(p)  _InterlockedIncrement(p)
+#define ZSON_ATOMIC_DEC(p)  _InterlockedDecrement(p)
+#define ZSON_ATOMIC_LOAD(p) _InterlockedExchangeAdd(p, 0)
+#define ZSON_ATOMIC_CAS_PTR(p, o, n) _InterlockedCompareExchangePointer((void* volatile*)(p), n, o)
+#else
+#define ZSON_ATOMIC_INC(p)  (++*(p))  /* no atomics, share copies within one thread only */
+#define ZSON_ATOMIC_DEC(p)  (--*(p))
+#define ZSON_ATOMIC_LOAD(p) (*(p))
+#define ZSON_ATOMIC_CAS_PTR(p, o, n) (*(p) == (o) ? (*(p) = (n), (o)) : *(p))
+#endif
+
+/* Work handed to another thread. Without ZSON_THREADS, or if no thread can be started, it runs inline. */
+typedef struct {
+    void (*run)(void* arg);
+    void* arg;
+#if defined(ZSON_THREADS) && defined(_WIN32)
+    HANDLE t;
+#elif defined(ZSON_THREADS)
+    pthread_t t;
+#endif
+    int started;
+}zson_job;
+
+#if defined(ZSON_THREADS) && defined(_WIN32)
+static DWORD WINAPI zson_job_main(LPVOID job) {
+    ((zson_job*)job)->run(((zson_job*)job)->arg);
+    return 0;
+}
+#elif defined(ZSON_THREADS)
+static void* zson_job_main(void* job) {
+    ((zson_job*)job)->run(((zson_job*)job)->arg);
+    return NULL;
+}
+#endif
+
+static void zson_start_job(zson_job* j) {
+#if defined(ZSON_THREADS) && defined(_WIN32)
+    j->started = (j->t = CreateThread(NULL, 0, zson_job_main, j, 0, NULL)) != NULL;
+#elif defined(ZSON_THREADS)
+    j->started = pthread_create(&j->t, NULL, zson_job_main, j) == 0;
+#else
+    j->started = 0;
+#endif
+    if (!j->started)
+        j->run(j->arg);
+}
+
+static void zson_join_job(zson_job* j) {
+    if (!j->started)
+        return;
+#if defined(ZSON_THREADS) && defined(_WIN32)
+    WaitForSingleObject(j->t, INFINITE);
+    CloseHandle(j->t);
+#elif defined(ZSON_THREADS)
+    pthread_join(j->t, NULL);
+#endif
+}
+
+typedef struct {
+    char* k; size_t klen;   /* projected key, key length */
+    zson_projection* p;     /* projection of the member value */
+}zson_projection_field;
+
+struct zson_projection {
+    zson_projection_field* f; size_t size, capacity;
+    int all;                /* keep the whole value */
+    zson_allocator a;       /* allocator the projection was created with */
+};
+
+#define ZSON_SCHEMA_NULL      0x01
+#define ZSON_SCHEMA_BOOLEAN   0x02
+#define ZSON_SCHEMA_INTEGER   0x04
+#define ZSON_SCHEMA_NUMBER    0x08
+#define ZSON_SCHEMA_STRING    0x10
+#define ZSON_SCHEMA_ARRAY     0x20
+#define ZSON_SCHEMA_OBJECT    0x40
+#define ZSON_SCHEMA_ANY       0x7F
+
+#define ZSON_SCHEMA_MINIMUM     0x1
+#define ZSON_SCHEMA_MAXIMUM     0x2
+#define ZSON_SCHEMA_MAX_LENGTH  0x4
+
+typedef struct {
+    char* k; size_t klen;   /* property key, key length */
+    zson_schema* s;         /* schema of the member value, NULL for keys that are only required */
+    int required;
+}zson_schema_field;
+
+struct zson_schema {
+    unsigned types;         /* ZSON_SCHEMA_* of the allowed types */
+    unsigned checks;        /* ZSON_SCHEMA_MINIMUM, ZSON_SCHEMA_MAXIMUM and ZSON_SCHEMA_MAX_LENGTH */
+    double minimum, maximum;
+    size_t max_length;      /* in code points */
+    zson_schema_field* f; size_t size, capacity, required; /* properties sorted like projections */
+    zson_schema* items;     /* schema of array elements, NULL accepts everything */
+    zson_value e;           /* array of allowed values, null when there is no enum */
+    zson_allocator a;       /* allocator the schema was created with */
+};
+
+static void* zson_std_allocate(void* ctx, size_t size) {
+    (void)ctx;
+    return malloc(size);
+}
+
+static void* zson_std_reallocate(void* ctx, void* ptr, size_t size) {
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static void zson_std_deallocate(void* ctx, void* ptr) {
+    (void)ctx;
+    free(ptr);
+}
+
+static zson_allocator zson_global_allocator = { zson_std_allocate, zson_std_reallocate, zson_std_deallocate, NULL };
+
+void zson_set_allocator(const zson_allocator* allocator) {
+    if (allocator != NULL) {
+        assert(allocator->allocate != NULL && allocator->reallocate != NULL && allocator->deallocate != NULL);
+        zson_global_allocator = *allocator;
+    }
+    else {
+        zson_global_allocator.allocate = zson_std_allocate;
+        zson_global_allocator.reallocate = zson_std_reallocate;
+        zson_global_allocator.deallocate = zson_std_deallocate;
+        zson_global_allocator.ctx = NULL;
+    }
+}
+
+void zson_get_allocator(zson_allocator* allocator) {
+    assert(allocator != NULL);
+    *allocator = zson_global_allocator;
+}
+
+static void zson_context_init(zson_context* c, void* local, size_t size) {
+    c->json = NULL;
+    c->stack = c->local = (char*)local;
+    c->size = size;
+    c->top = 0;
+    c->a = c->va = &zson_global_allocator;
+    c->max_depth = ZSON_PARSE_MAX_DEPTH;
+    c->proj = NULL;
+    c->schema = NULL;
+    c->flags = 0;
+}
+
+static void zson_context_release(zson_context* c) {
+    if (c->stack != c->local)
+        ZSON_DEALLOC(c->a, c->stack);
+}
+
 static void* zson_context_push(zson_context* c, size_t size) {
     void* ret;
+    ZSON_TRACE_DECL(mark)
     assert(size > 0);
-    if (c->top + size >= c->size) {
+    if (c->top + size > c->size) {
+        ZSON_STAT(stack_growths, 1);
+        ZSON_TRACE_BEGIN(ZSON_TRACE_STACK_GROWTH, mark);
         if (c->size == 0)
             c->size = ZSON_PARSE_STACK_INIT_SIZE;
-        while (c->top + size >= c->size)
+        while (c->top + size > c->size)
             c->size += c->size >> 1;  /* c->size * 1.5 */
-        c->stack = (char*)realloc(c->stack, c->size);
+        if (c->stack == c->local) {
+            /* first growth, the caller's initial stack (if any) is left alone */
+            char* stack = (char*)ZSON_ALLOC(c->a, c->size);
+            if (c->top > 0)
+                memcpy(stack, c->local, c->top);
+            c->stack = stack;
+        }
+        else
+            c->stack = (char*)ZSON_REALLOC(c->a, c->stack, c->size);
+        ZSON_TRACE_END(ZSON_TRACE_STACK_GROWTH, mark, c->size);
     }
     ret = c->stack + c->top;
     c->top += size;
@@ -50,11 +446,305 @@ static void* zson_context_pop(zson_context* c, size_t size) {
     return c->stack + (c->top -= size);
 }
 
+static void zson_walk_push(zson_context* s, const zson_value* v, const zson_value* w) {
+    zson_walk_frame* f = (zson_walk_frame*)zson_context_push(s, sizeof(zson_walk_frame));
+    f->v = v;
+    f->w = w;
+    f->i = 0;
+}
+
+static void* zson_block_alloc(const zson_allocator* a, size_t size) {
+    zson_block* b = (zson_block*)ZSON_ALLOC(a, ZSON_BLOCK_HEADER * sizeof(zson_block) + size) + ZSON_BLOCK_HEADER;
+    ZSON_BLOCK(b)->refs = 1;
+    ZSON_OWNER(b) = a;
+    return b;
+}
+
+/* Only for blocks that are not shared and not compacted; a is only used if there is no block yet. */
+static void* zson_block_realloc(const zson_allocator* a, void* data, size_t size) {
+    if (data == NULL)
+        return zson_block_alloc(a, size);
+    assert(ZSON_BLOCK(data)->refs == 1);
+    a = ZSON_OWNER(data);
+    return (zson_block*)ZSON_REALLOC(a, (zson_block*)data - ZSON_BLOCK_HEADER, ZSON_BLOCK_HEADER * sizeof(zson_block) + size) + ZSON_BLOCK_HEADER;
+}
+
+static void zson_block_free(void* data) {
+    ZSON_DEALLOC(ZSON_OWNER(data), (zson_block*)data - ZSON_BLOCK_HEADER);
+}
+
+/* Allocator for copies of a block, the one of its arena if it was compacted. */
+static const zson_allocator* zson_data_allocator(void* data, unsigned flags) {
+    return flags & ZSON_COMPACT ? ZSON_OWNER(ZSON_ARENA(data)) : ZSON_OWNER(data);
+}
+
+/* Allocator for copies of a value, the global one if it has no block. */
+static const zson_allocator* zson_value_allocator(const zson_value* v) {
+    if ((ZSON_TYPE_OF(v) == ZSON_STRING || ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT) && WALK_DATA(v) != NULL)
+        return zson_data_allocator(WALK_DATA(v), ZSON_FLAGS_OF(v));
+    return &zson_global_allocator;
+}
+
+/* Record the capacity of a container after its data was (re)allocated; compacted blocks are exact. */
+static void zson_set_capacity(zson_value* v, size_t capacity) {
+#ifdef ZSON_SMALL_VALUES
+    if (WALK_DATA(v) != NULL && !(ZSON_FLAGS_OF(v) & ZSON_COMPACT))
+        ((zson_block*)WALK_DATA(v) - 3)->n = capacity;
+#else
+    if (ZSON_TYPE_OF(v) == ZSON_ARRAY)
+        v->u.a.capacity = capacity;
+    else
+        v->u.o.capacity = capacity;
+#endif
+}
+
+/* Drop a reference, nonzero when it was the last one and the block must be freed. */
+static int zson_block_unref(void* data) {
+    zson_block* b = ZSON_BLOCK(data);
+    return b->refs == 1 || ZSON_ATOMIC_DEC(&b->refs) == 0;
+}
+
+/* Blocks moved by zson_compact() are not freed on their own, the last one frees the whole arena. */
+static void zson_free_data(void* data, unsigned flags) {
+    if (!(flags & ZSON_COMPACT))
+        zson_block_free(data);
+    else if (zson_block_unref(ZSON_ARENA(data)))
+        zson_block_free(ZSON_ARENA(data));
+}
+
+/* Add a reference to the block of a string or container, if it has one. */
+static void zson_ref_value(const zson_value* v) {
+    void* data = ZSON_TYPE_OF(v) == ZSON_STRING ? (void*)ZSON_STRING_OF(v) :
+        ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT ? WALK_DATA(v) : NULL;
+    if (data != NULL)
+        ZSON_ATOMIC_INC(&ZSON_BLOCK(data)->refs);
+}
+
+/* Every block goes back to the allocator recorded in it. */
+static void zson_release(zson_value* v) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        /* containers are released after their children, shared blocks only lose a reference */
+        switch (ZSON_TYPE_OF(v)) {
+            case ZSON_STRING:
+                if (zson_block_unref(ZSON_STRING_OF(v)))
+                    zson_free_data(ZSON_STRING_OF(v), ZSON_FLAGS_OF(v));
+                break;
+            case ZSON_ARRAY:
+            case ZSON_OBJECT:
+                if (WALK_DATA(v) != NULL && zson_block_unref(WALK_DATA(v))) {
+                    if (ZSON_FLAGS_OF(v) & ZSON_PACKED)
+                        zson_free_data(WALK_DATA(v), ZSON_FLAGS_OF(v));
+                    else
+                        zson_walk_push(&s, v, NULL);
+                }
+                break;
+            default: break;
+        }
+        if (s.top == 0 || WALK_TOP(&s)->v != v)
+            ZSON_SET_TYPE(v, ZSON_NULL);
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            v = (zson_value*)f->v;
+            zson_free_data(WALK_DATA(v), ZSON_FLAGS_OF(v));
+            ZSON_SET_TYPE(v, ZSON_NULL);
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY)
+            v = &ZSON_ELEMENTS_OF(f->v)[f->i++];
+        else {
+            if (!(ZSON_FLAGS_OF(f->v) & ZSON_COMPACT))
+                ZSON_DEALLOC(ZSON_OWNER(ZSON_MEMBERS_OF(f->v)), ZSON_MEMBERS_OF(f->v)[f->i].k);
+            v = &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+        }
+    }
+}
+
+static void zson_alloc_string(zson_value* v, const char* s, size_t len, const zson_allocator* a) {
+    zson_release(v);
+    ZSON_SET_TYPE(v, ZSON_STRING);
+    ZSON_SET_DATA(v, zson_block_alloc(a, len + 1));
+    memcpy(ZSON_STRING_OF(v), s, len);
+    ZSON_STRING_OF(v)[len] = '\0';
+    v->u.s.len = len;
+}
+
+static void zson_alloc_array(zson_value* v, size_t capacity, const zson_allocator* a) {
+    zson_release(v);
+    ZSON_SET_TYPE(v, ZSON_ARRAY);
+    v->u.a.size = 0;
+    ZSON_SET_DATA(v, capacity > 0 ? zson_block_alloc(a, capacity * sizeof(zson_value)) : NULL);
+    zson_set_capacity(v, capacity);
+}
+
+/* Packed representation of the elements, 0 unless all are floating point or all are zson_int64. */
+static unsigned zson_packable(const zson_value* e, size_t size) {
+    unsigned flags;
+    size_t i;
+    if (size == 0 || ZSON_TYPE_OF(&e[0]) != ZSON_NUMBER || (ZSON_FLAGS_OF(&e[0]) != 0 && ZSON_FLAGS_OF(&e[0]) != ZSON_INT64))
+        return 0;
+    flags = ZSON_FLAGS_OF(&e[0]);
+    for (i = 1; i < size; i++)
+        if (ZSON_TYPE_OF(&e[i]) != ZSON_NUMBER || ZSON_FLAGS_OF(&e[i]) != flags)
+            return 0;
+    return flags == ZSON_INT64 ? ZSON_PACKED_INT64 : ZSON_PACKED_DOUBLE;
+}
+
+static void zson_alloc_packed(zson_value* v, const zson_value* e, size_t size, unsigned packed, const zson_allocator* a) {
+    size_t i;
+    zson_release(v);
+    ZSON_SET_TYPE(v, ZSON_ARRAY);
+    ZSON_SET_FLAGS(v, packed);
+    v->u.a.size = size;
+    if (packed == ZSON_PACKED_INT64) {
+        ZSON_SET_DATA(v, zson_block_alloc(a, size * sizeof(zson_int64)));
+        for (i = 0; i < size; i++)
+            PACKED_INT64S(v)[i] = e[i].u.i;
+    }
+    else {
+        ZSON_SET_DATA(v, zson_block_alloc(a, size * sizeof(double)));
+        for (i = 0; i < size; i++)
+            PACKED_DOUBLES(v)[i] = ZSON_NUMBER_OF(&e[i]);
+    }
+    zson_set_capacity(v, size);
+}
+
+/* Element i of an array, elements of packed arrays are made up in scratch. */
+static const zson_value* zson_array_element(const zson_value* v, size_t i, zson_value* scratch) {
+    if (!(ZSON_FLAGS_OF(v) & ZSON_PACKED))
+        return &ZSON_ELEMENTS_OF(v)[i];
+    if (ZSON_FLAGS_OF(v) & ZSON_PACKED_INT64)
+        ZSON_SET_INT64(scratch, PACKED_INT64S(v)[i]);
+    else
+        ZSON_SET_DOUBLE(scratch, PACKED_DOUBLES(v)[i]);
+    return scratch;
+}
+
+static void zson_alloc_object(zson_value* v, size_t capacity, const zson_allocator* a) {
+    zson_release(v);
+    ZSON_SET_TYPE(v, ZSON_OBJECT);
+    v->u.o.size = 0;
+    ZSON_SET_DATA(v, capacity > 0 ? zson_block_alloc(a, capacity * sizeof(zson_member)) : NULL);
+    zson_set_capacity(v, capacity);
+}
+
+/*
+ * Copy-on-write: give a container its own block before it is modified, its children become shared.
+ * Packed arrays are unpacked, their elements are handed out as zson_value. Compacted blocks cannot
+ * grow in their arena, so they are copied out as well.
+ */
+static void zson_unshare(zson_value* v) {
+    const zson_allocator* a;
+    zson_value old, scratch;
+    size_t i, capacity;
+    if (ZSON_FLAGS_OF(v) & ZSON_FROZEN)
+        return;
+    if (ZSON_FLAGS_OF(v) & ZSON_PACKED) {
+        a = zson_data_allocator(WALK_DATA(v), ZSON_FLAGS_OF(v));
+        memcpy(&old, v, sizeof(zson_value));
+        capacity = ZSON_CAPACITY(v);
+        ZSON_SET_FLAGS(v, 0);
+        ZSON_SET_DATA(v, zson_block_alloc(a, capacity * sizeof(zson_value)));
+        zson_set_capacity(v, capacity);
+        for (i = 0; i < v->u.a.size; i++)
+            memcpy(&ZSON_ELEMENTS_OF(v)[i], zson_array_element(&old, i, &scratch), sizeof(zson_value));
+        zson_release(&old);
+        return;
+    }
+    if (WALK_DATA(v) == NULL || (ZSON_BLOCK(WALK_DATA(v))->refs == 1 && !(ZSON_FLAGS_OF(v) & ZSON_COMPACT)))
+        return;
+    a = zson_data_allocator(WALK_DATA(v), ZSON_FLAGS_OF(v));
+    memcpy(&old, v, sizeof(zson_value));
+    capacity = ZSON_CAPACITY(v);
+    ZSON_SET_FLAGS(v, ZSON_FLAGS_OF(v) & ~ZSON_COMPACT);
+    if (ZSON_TYPE_OF(v) == ZSON_ARRAY) {
+        ZSON_SET_DATA(v, zson_block_alloc(a, capacity * sizeof(zson_value)));
+        zson_set_capacity(v, capacity);
+        memcpy(ZSON_ELEMENTS_OF(v), ZSON_ELEMENTS_OF(&old), v->u.a.size * sizeof(zson_value));
+        for (i = 0; i < v->u.a.size; i++)
+            zson_ref_value(&ZSON_ELEMENTS_OF(v)[i]);
+    }
+    else {
+        ZSON_SET_DATA(v, zson_block_alloc(a, capacity * sizeof(zson_member)));
+        zson_set_capacity(v, capacity);
+        memcpy(ZSON_MEMBERS_OF(v), ZSON_MEMBERS_OF(&old), v->u.o.size * sizeof(zson_member));
+        for (i = 0; i < v->u.o.size; i++) {
+            zson_member* m = &ZSON_MEMBERS_OF(v)[i];
+            memcpy(m->k = (char*)ZSON_ALLOC(a, m->klen + 1), ZSON_MEMBERS_OF(&old)[i].k, m->klen + 1);
+            zson_ref_value(&m->v);
+        }
+    }
+    zson_release(&old);  /* frees the old block too if the other owners let go meanwhile */
+}
+
+/* Before elements are handed out for writing in place, which compacted blocks allow if not shared. */
+static void zson_unshare_elements(zson_value* v) {
+    if ((ZSON_FLAGS_OF(v) & (ZSON_COMPACT | ZSON_PACKED)) == ZSON_COMPACT && ZSON_BLOCK(WALK_DATA(v))->refs == 1)
+        return;
+    zson_unshare(v);
+}
+
+#ifdef ZSON_SSE2
+static unsigned zson_ctz(unsigned mask) {
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctz(mask);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned)index;
+#else
+    unsigned n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+#endif
+
+/*
+ * Most tokens are followed by no whitespace or a single space, longer runs (indentation) are skipped
+ * 16 bytes at a time. Aligned loads may read past the terminating NUL but never into another page.
+ */
 static void zson_parse_whitespace(zson_context* c) {
     const char *p = c->json;
+    if (*p == ' ')
+        p++;
+    if ((unsigned char)*p > ' ') {
+        c->json = p;
+        return;
+    }
+#ifdef ZSON_SSE2_OVERREAD
+    {
+        const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), lf = _mm_set1_epi8('\n'), cr = _mm_set1_epi8('\r');
+        const char* a = (const char*)((size_t)p & ~(size_t)15);
+        unsigned mask;
+        for (;; a += 16) {
+            __m128i x = _mm_load_si128((const __m128i*)a);
+            __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)),
+                _mm_or_si128(_mm_cmpeq_epi8(x, lf), _mm_cmpeq_epi8(x, cr)));
+            mask = ~(unsigned)_mm_movemask_epi8(ws) & 0xFFFF;
+            if (a < p)
+                mask &= 0xFFFFu << (p - a);
+            if (mask != 0)
+                break;
+        }
+        c->json = a + zson_ctz(mask);
+    }
+#else
     while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
         p++;
     c->json = p;
+#endif
 }
 
 static int zson_parse_literal(zson_context* c, zson_value* v, const char* literal, zson_type type) {
@@ -64,12 +754,36 @@ static int zson_parse_literal(zson_context* c, zson_value* v, const char* litera
         if (c->json[i] != literal[i + 1])
             return ZSON_PARSE_INVALID_VALUE;
     c->json += i;
-    v->type = type;
+    ZSON_SET_TYPE(v, type);
     return ZSON_PARSE_OK;
 }
 
+/* Integer literals are accumulated exactly, -0 and anything out of range go through strtod(). */
+static int zson_parse_integer(const char* p, const char* end, zson_value* v) {
+    zson_uint64 u = 0;
+    int neg = *p == '-';
+    for (p += neg; p < end; p++) {
+        unsigned d = *p - '0';
+        if (u > (ZSON_UINT64_MAX - d) / 10)
+            return 0;
+        u = u * 10 + d;
+    }
+    if (neg) {
+        if (u == 0 || u > (zson_uint64)ZSON_INT64_MAX + 1)
+            return 0;
+        ZSON_SET_INT64(v, (zson_int64)(0 - u));
+    }
+    else if (u <= (zson_uint64)ZSON_INT64_MAX)
+        ZSON_SET_INT64(v, (zson_int64)u);
+    else
+        ZSON_SET_UINT64(v, u);
+    return 1;
+}
+
 static int zson_parse_number(zson_context* c, zson_value* v) {
     const char* p = c->json;
+    int integral = 1;
+    double d;
     if (*p == '-') p++;
     if (*p == '0') p++;
     else {
@@ -80,18 +794,22 @@ static int zson_parse_number(zson_context* c, zson_value* v) {
         p++;
         if (!ISDIGIT(*p)) return ZSON_PARSE_INVALID_VALUE;
         for (p++; ISDIGIT(*p); p++);
+        integral = 0;
     }
     if (*p == 'e' || *p == 'E') {
         p++;
         if (*p == '+' || *p == '-') p++;
         if (!ISDIGIT(*p)) return ZSON_PARSE_INVALID_VALUE;
         for (p++; ISDIGIT(*p); p++);
+        integral = 0;
+    }
+    if (!integral || !zson_parse_integer(c->json, p, v)) {
+        errno = 0;
+        d = strtod(c->json, NULL);
+        if (errno == ERANGE && (d == HUGE_VAL || d == -HUGE_VAL))
+            return ZSON_PARSE_NUMBER_TOO_BIG;
+        ZSON_SET_DOUBLE(v, d);
     }
-    errno = 0;
-    v->u.n = strtod(c->json, NULL);
-    if (errno == ERANGE && (v->u.n == HUGE_VAL || v->u.n == -HUGE_VAL))
-        return ZSON_PARSE_NUMBER_TOO_BIG;
-    v->type = ZSON_NUMBER;
     c->json = p;
     return ZSON_PARSE_OK;
 }
@@ -110,6 +828,31 @@ static const char* zson_parse_hex4(const char* p, unsigned* u) {
     return p;
 }
 
+/* Decode one UTF-8 sequence, ill-formed input decodes to U+FFFD one byte at a time. */
+static unsigned zson_decode_utf8(const unsigned char* s, size_t len, size_t* n) {
+    unsigned u, lo = 0x80, hi = 0xBF;
+    size_t i, count;
+    if      (s[0] >= 0xC2 && s[0] <= 0xDF) { count = 2; u = s[0] & 0x1F; }
+    else if (s[0] >= 0xE0 && s[0] <= 0xEF) { count = 3; u = s[0] & 0x0F; lo = s[0] == 0xE0 ? 0xA0 : 0x80; hi = s[0] == 0xED ? 0x9F : 0xBF; }
+    else if (s[0] >= 0xF0 && s[0] <= 0xF4) { count = 4; u = s[0] & 0x07; lo = s[0] == 0xF0 ? 0x90 : 0x80; hi = s[0] == 0xF4 ? 0x8F : 0xBF; }
+    else {
+        *n = 1;
+        return s[0] < 0x80 ? s[0] : 0xFFFD;
+    }
+    *n = 1;
+    if (count > len)
+        return 0xFFFD;
+    for (i = 1; i < count; i++) {
+        if (s[i] < lo || s[i] > hi)
+            return 0xFFFD;
+        u = (u << 6) | (s[i] & 0x3F);
+        lo = 0x80;
+        hi = 0xBF;
+    }
+    *n = count;
+    return u;
+}
+
 static void zson_encode_utf8(zson_context* c, unsigned u) {
     if (u <= 0x7F) 
         PUTC(c, u & 0xFF);
@@ -131,23 +874,59 @@ static void zson_encode_utf8(zson_context* c, unsigned u) {
     }
 }
 
+/*
+ * Skip the run of string bytes copied as they are: no '"', '\\', control character (the NUL
+ * included), or byte above 0x7F when those are validated. 16 bytes at a time like whitespace.
+ */
+static const char* zson_skip_plain(const char* p, int ascii) {
+#ifdef ZSON_SSE2_OVERREAD
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+    const char* a = (const char*)((size_t)p & ~(size_t)15);
+    unsigned mask;
+    for (;; a += 16) {
+        __m128i x = _mm_load_si128((const __m128i*)a);
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(x, control), control)); /* x <= 0x1F */
+        mask = (unsigned)_mm_movemask_epi8(m);
+        if (ascii)
+            mask |= (unsigned)_mm_movemask_epi8(x);
+        if (a < p)
+            mask &= 0xFFFFu << (p - a);
+        if (mask != 0)
+            return a + zson_ctz(mask);
+    }
+#else
+    for (;; p++) {
+        unsigned char ch = (unsigned char)*p;
+        if (ch == '"' || ch == '\\' || ch < 0x20 || (ascii && ch >= 0x80))
+            return p;
+    }
+#endif
+}
+
 #define STRING_ERROR(ret) do { c->top = head; return ret; } while(0)
 
 static int zson_parse_string_raw(zson_context* c, char** str, size_t* len) {
-    size_t head = c->top;
+    size_t head = c->top, n;
+    int strict = (c->flags & ZSON_PARSE_STRICT_UTF8) != 0;
     unsigned u, u2;
-    const char* p;
+    const char* p, *q;
     EXPECT(c, '\"');
     p = c->json;
     for (;;) {
-        char ch = *p++;
-        switch (ch) {
+        char ch;
+        if ((q = zson_skip_plain(p, strict)) != p) {
+            PUTS(c, p, (size_t)(q - p));
+            p = q;
+        }
+        switch (ch = *p++) {
             case '\"':
                 *len = c->top - head;
                 *str = zson_context_pop(c, *len);
                 c->json = p;
                 return ZSON_PARSE_OK;
             case '\\':
+                ZSON_TRACE_COUNT(escapes_parsed);
                 switch (*p++) {
                     case '\"': PUTC(c, '\"'); break;
                     case '\\': PUTC(c, '\\'); break;
@@ -182,7 +961,12 @@ static int zson_parse_string_raw(zson_context* c, char** str, size_t* len) {
             default:
                 if ((unsigned char)ch < 0x20)
                     STRING_ERROR(ZSON_PARSE_INVALID_STRING_CHAR);
-                PUTC(c, ch);
+                assert(strict && (unsigned char)ch >= 0x80);
+                zson_decode_utf8((const unsigned char*)p - 1, 4, &n);  /* stops at the NUL */
+                if (n == 1)
+                    STRING_ERROR(ZSON_PARSE_INVALID_UTF8);
+                PUTS(c, p - 1, n);
+                p += n - 1;
         }
     }
 }
@@ -192,563 +976,3520 @@ static int zson_parse_string(zson_context* c, zson_value* v) {
     char* s;
     size_t len;
     if ((ret = zson_parse_string_raw(c, &s, &len)) == ZSON_PARSE_OK)
-        zson_set_string(v, s, len);
+        zson_alloc_string(v, s, len, c->va);
     return ret;
 }
 
-static int zson_parse_value(zson_context* c, zson_value* v);
+/* Order of projection, schema and frozen object keys, by length first so most comparisons skip memcmp(). */
+static int zson_compare_key(const char* lhs, size_t llen, const char* rhs, size_t rlen) {
+    if (llen != rlen)
+        return llen < rlen ? -1 : 1;
+    return memcmp(lhs, rhs, llen);
+}
 
-static int zson_parse_array(zson_context* c, zson_value* v) {
-    size_t i, size = 0;
-    int ret;
-    EXPECT(c, '[');
-    zson_parse_whitespace(c);
-    if (*c->json == ']') {
-        c->json++;
-        zson_set_array(v, 0);
-        return ZSON_PARSE_OK;
+static const zson_projection* zson_find_projection(const zson_projection* p, const char* key, size_t klen) {
+    size_t lo = 0, hi = p->size;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) >> 1);
+        const zson_projection_field* f = &p->f[mid];
+        int cmp = zson_compare_key(f->k, f->klen, key, klen);
+        if (cmp == 0)
+            return f->p;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    for (;;) {
-        zson_value e;
-        zson_init(&e);
-        if ((ret = zson_parse_value(c, &e)) != ZSON_PARSE_OK)
-            break;
-        memcpy(zson_context_push(c, sizeof(zson_value)), &e, sizeof(zson_value));
-        size++;
-        zson_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json++;
-            zson_parse_whitespace(c);
-        }
-        else if (*c->json == ']') {
-            c->json++;
-            zson_set_array(v, size);
-            memcpy(v->u.a.e, zson_context_pop(c, size * sizeof(zson_value)), size * sizeof(zson_value));
-            v->u.a.size = size;
-            return ZSON_PARSE_OK;
-        }
-        else {
-            ret = ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET;
-            break;
-        }
+    return NULL;
+}
+
+static const zson_schema_field* zson_find_schema_field(const zson_schema* s, const char* key, size_t klen) {
+    size_t lo = 0, hi = s->size;
+    while (lo < hi) {
+        size_t mid = lo + ((hi - lo) >> 1);
+        int cmp = zson_compare_key(s->f[mid].k, s->f[mid].klen, key, klen);
+        if (cmp == 0)
+            return &s->f[mid];
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    /* Pop and free values on the stack */
-    for (i = 0; i < size; i++)
-        zson_free((zson_value*)zson_context_pop(c, sizeof(zson_value)));
-    return ret;
+    return NULL;
 }
 
-static int zson_parse_object(zson_context* c, zson_value* v) {
-    size_t i, size;
-    zson_member m;
-    int ret;
-    EXPECT(c, '{');
-    zson_parse_whitespace(c);
-    if (*c->json == '}') {
-        c->json++;
-        zson_set_object(v, 0);
-        return ZSON_PARSE_OK;
+static unsigned zson_schema_type(const zson_value* v) {
+    double n;
+    switch (ZSON_TYPE_OF(v)) {
+        case ZSON_NULL:   return ZSON_SCHEMA_NULL;
+        case ZSON_FALSE:
+        case ZSON_TRUE:   return ZSON_SCHEMA_BOOLEAN;
+        case ZSON_STRING: return ZSON_SCHEMA_STRING;
+        case ZSON_ARRAY:  return ZSON_SCHEMA_ARRAY;
+        case ZSON_OBJECT: return ZSON_SCHEMA_OBJECT;
+        default: break;
     }
-    m.k = NULL;
-    size = 0;
-    for (;;) {
-        char* str;
-        zson_init(&m.v);
-        /* parse key */
-        if (*c->json != '"') {
-            ret = ZSON_PARSE_MISS_KEY;
-            break;
-        }
-        if ((ret = zson_parse_string_raw(c, &str, &m.klen)) != ZSON_PARSE_OK)
-            break;
-        memcpy(m.k = (char*)malloc(m.klen + 1), str, m.klen);
-        m.k[m.klen] = '\0';
-        /* parse ws colon ws */
-        zson_parse_whitespace(c);
-        if (*c->json != ':') {
-            ret = ZSON_PARSE_MISS_COLON;
-            break;
-        }
-        c->json++;
-        zson_parse_whitespace(c);
-        /* parse value */
-        if ((ret = zson_parse_value(c, &m.v)) != ZSON_PARSE_OK)
-            break;
-        memcpy(zson_context_push(c, sizeof(zson_member)), &m, sizeof(zson_member));
-        size++;
-        m.k = NULL; /* ownership is transferred to member on stack */
-        /* parse ws [comma | right-curly-brace] ws */
-        zson_parse_whitespace(c);
-        if (*c->json == ',') {
-            c->json++;
-            zson_parse_whitespace(c);
-        }
-        else if (*c->json == '}') {
-            c->json++;
-            zson_set_object(v, size);
-            memcpy(v->u.o.m, zson_context_pop(c, sizeof(zson_member) * size), sizeof(zson_member) * size);
-            v->u.o.size = size;
-            return ZSON_PARSE_OK;
-        }
-        else {
-            ret = ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
-            break;
-        }
+    if (ZSON_FLAGS_OF(v) & ZSON_INTEGER)
+        return ZSON_SCHEMA_INTEGER | ZSON_SCHEMA_NUMBER;
+    /* doubles outside the zson_int64 range have no fraction bits */
+    n = ZSON_NUMBER_OF(v);
+    if (n > -9.2e18 && n < 9.2e18 ? n == (double)(zson_int64)n : n == n)
+        return ZSON_SCHEMA_INTEGER | ZSON_SCHEMA_NUMBER;
+    return ZSON_SCHEMA_NUMBER;
+}
+
+/* Check everything but the required members of a finished value. */
+static int zson_match_schema(const zson_schema* s, const zson_value* v) {
+    zson_value scratch;
+    size_t i, n;
+    if (!(zson_schema_type(v) & s->types))
+        return 0;
+    if (ZSON_TYPE_OF(v) == ZSON_NUMBER) {
+        double d = zson_get_number(v);
+        if (((s->checks & ZSON_SCHEMA_MINIMUM) && d < s->minimum) || ((s->checks & ZSON_SCHEMA_MAXIMUM) && d > s->maximum))
+            return 0;
     }
-    /* Pop and free members on the stack */
-    free(m.k);
-    for (i = 0; i < size; i++) {
-        zson_member* m = (zson_member*)zson_context_pop(c, sizeof(zson_member));
-        free(m->k);
-        zson_free(&m->v);
+    else if (ZSON_TYPE_OF(v) == ZSON_STRING && (s->checks & ZSON_SCHEMA_MAX_LENGTH) && v->u.s.len > s->max_length) {
+        for (i = n = 0; i < v->u.s.len; i++)
+            n += ((unsigned char)ZSON_STRING_OF(v)[i] & 0xC0) != 0x80; /* count lead bytes only */
+        if (n > s->max_length)
+            return 0;
     }
-    v->type = ZSON_NULL;
-    return ret;
+    if (ZSON_TYPE_OF(&s->e) == ZSON_ARRAY) {
+        for (i = 0; i < s->e.u.a.size; i++)
+            if (zson_is_equal(zson_array_element(&s->e, i, &scratch), v))
+                return 1;
+        return 0;
+    }
+    return 1;
 }
 
-static int zson_parse_value(zson_context* c, zson_value* v) {
-    switch (*c->json) {
-        case 't':  return zson_parse_literal(c, v, "true", ZSON_TRUE);
-        case 'f':  return zson_parse_literal(c, v, "false", ZSON_FALSE);
-        case 'n':  return zson_parse_literal(c, v, "null", ZSON_NULL);
-        default:   return zson_parse_number(c, v);
-        case '"':  return zson_parse_string(c, v);
-        case '[':  return zson_parse_array(c, v);
-        case '{':  return zson_parse_object(c, v);
-        case '\0': return ZSON_PARSE_EXPECT_VALUE;
-    }
+/* Check that the members pushed above an object frame include every required key. */
+static int zson_match_required(const zson_schema* s, const zson_member* m, size_t size) {
+    size_t i, j;
+    if (s->required == 0)
+        return 1;
+    for (i = 0; i < s->size; i++)
+        if (s->f[i].required) {
+            for (j = 0; j < size; j++)
+                if (m[j].klen == s->f[i].klen && memcmp(m[j].k, s->f[i].k, m[j].klen) == 0)
+                    break;
+            if (j == size)
+                return 0;
+        }
+    return 1;
 }
 
-int zson_parse(zson_value* v, const char* json) {
-    zson_context c;
-    int ret;
+/* Skip a value without building it. Only quotes and bracket nesting are checked. */
+static int zson_skip_value(zson_context* c) {
+    size_t head = c->top;
+    const char* p = c->json;
+    int ret;
+    for (;;) {
+        switch (*p) {
+            case '\"':
+                for (p++; *p != '\"'; p++) {
+                    if (*p == '\0')
+                        STRING_ERROR(ZSON_PARSE_MISS_QUOTATION_MARK);
+                    if (*p == '\\' && p[1] != '\0')
+                        p++;
+                }
+                p++;
+                if (c->top == head)
+                    goto done;
+                break;
+            case '[': PUTC(c, ']'); p++; break;
+            case '{': PUTC(c, '}'); p++; break;
+            case ']':
+            case '}':
+                if (c->top == head)
+                    goto done;
+                if (*(char*)zson_context_pop(c, sizeof(char)) != *p) {
+                    ret = *p == '}' ? ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                    STRING_ERROR(ret);
+                }
+                p++;
+                if (c->top == head)
+                    goto done;
+                break;
+            case ',': case ' ': case '\t': case '\n': case '\r':
+                if (c->top == head)
+                    goto done;
+                p++;
+                break;
+            case '\0':
+                if (c->top == head)
+                    goto done;
+                ret = c->stack[c->top - 1] == ']' ? ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+                STRING_ERROR(ret);
+            default:
+                p++;
+        }
+    }
+done:
+    if (p == c->json)
+        return *p == '\0' ? ZSON_PARSE_EXPECT_VALUE : ZSON_PARSE_INVALID_VALUE;
+    c->json = p;
+    return ZSON_PARSE_OK;
+}
+
+static int zson_parse_scalar(zson_context* c, zson_value* v) {
+    const char* json = c->json;
+    int ret;
+    ZSON_TRACE_DECL(mark)
+    switch (*c->json) {
+        case 't':  return zson_parse_literal(c, v, "true", ZSON_TRUE);
+        case 'f':  return zson_parse_literal(c, v, "false", ZSON_FALSE);
+        case 'n':  return zson_parse_literal(c, v, "null", ZSON_NULL);
+        default:
+            ZSON_TRACE_BEGIN(ZSON_TRACE_PARSE_NUMBER, mark);
+            ret = zson_parse_number(c, v);
+            ZSON_TRACE_END(ZSON_TRACE_PARSE_NUMBER, mark, (size_t)(c->json - json));
+            return ret;
+        case '"':
+            ZSON_TRACE_BEGIN(ZSON_TRACE_PARSE_STRING, mark);
+            ret = zson_parse_string(c, v);
+            ZSON_TRACE_END(ZSON_TRACE_PARSE_STRING, mark, (size_t)(c->json - json));
+            return ret;
+        case '\0': return ZSON_PARSE_EXPECT_VALUE;
+    }
+}
+
+static void zson_close_container(zson_context* c, zson_parse_frame* f, zson_value* v) {
+    size_t size = f->size;
+    if (f->type == ZSON_ARRAY) {
+        zson_value* e = (zson_value*)zson_context_pop(c, size * sizeof(zson_value));
+        unsigned packed = c->flags & ZSON_PARSE_PACK_ARRAYS ? zson_packable(e, size) : 0;
+        if (packed) {
+            zson_alloc_packed(v, e, size, packed, c->va);
+            return;
+        }
+        zson_alloc_array(v, size, c->va);
+        if (size > 0)
+            memcpy(ZSON_ELEMENTS_OF(v), e, size * sizeof(zson_value));
+        v->u.a.size = size;
+    }
+    else {
+        zson_alloc_object(v, size, c->va);
+        if (size > 0)
+            memcpy(ZSON_MEMBERS_OF(v), zson_context_pop(c, size * sizeof(zson_member)), size * sizeof(zson_member));
+        v->u.o.size = size;
+    }
+}
+
+/*
+ * Containers are parsed without recursion: each open container has a zson_parse_frame on the stack,
+ * followed by its finished elements or members. The slot of the value being parsed is pushed before
+ * parsing it, so a frame only needs stack offsets to find where its container goes when closed.
+ */
+static int zson_parse_value(zson_context* c, zson_value* v) {
+    size_t frame = ZSON_ROOT, slot = ZSON_ROOT, depth = 0, i;
+    zson_parse_frame* f;
+    zson_value e;
+    int ret;
+    for (;;) {
+        /* parse the value at c->json into slot */
+        if (*c->json == '[' || *c->json == '{') {
+            if (depth == c->max_depth) {
+                ret = ZSON_PARSE_NESTING_TOO_DEEP;
+                goto error;
+            }
+            if (c->schema != NULL && !(c->schema->types & (*c->json == '[' ? ZSON_SCHEMA_ARRAY : ZSON_SCHEMA_OBJECT))) {
+                ret = ZSON_PARSE_SCHEMA_MISMATCH;
+                goto error;
+            }
+            f = (zson_parse_frame*)zson_context_push(c, sizeof(zson_parse_frame));
+            f->prev = frame;
+            f->slot = slot;
+            f->size = 0;
+            f->proj = c->proj;
+            f->schema = c->schema;
+            f->type = *c->json == '[' ? ZSON_ARRAY : ZSON_OBJECT;
+#ifdef ZSON_TRACE
+            f->json = c->json;
+            zson_trace_begin(f->type == ZSON_ARRAY ? ZSON_TRACE_PARSE_ARRAY : ZSON_TRACE_PARSE_OBJECT, &f->mark);
+#endif
+            c->json++;
+            frame = c->top - sizeof(zson_parse_frame);
+            depth++;
+            zson_parse_whitespace(c);
+            if (*c->json == (f->type == ZSON_ARRAY ? ']' : '}')) {
+                c->json++;
+                goto close;
+            }
+            goto element;
+        }
+        zson_init(&e);
+        if ((ret = zson_parse_scalar(c, &e)) != ZSON_PARSE_OK)
+            goto error;
+        if (c->schema != NULL && !zson_match_schema(c->schema, &e)) {
+            zson_release(&e);
+            ret = ZSON_PARSE_SCHEMA_MISMATCH;
+            goto error;
+        }
+        memcpy(slot == ZSON_ROOT ? v : (zson_value*)(c->stack + slot), &e, sizeof(zson_value));
+    next:
+        /* a value is finished, parse ws [comma | closing bracket] ws of the enclosing container */
+        if (frame == ZSON_ROOT)
+            return ZSON_PARSE_OK;
+        f = (zson_parse_frame*)(c->stack + frame);
+        zson_parse_whitespace(c);
+        if (*c->json == ',') {
+            c->json++;
+            zson_parse_whitespace(c);
+        }
+        else if (*c->json == (f->type == ZSON_ARRAY ? ']' : '}')) {
+            c->json++;
+            goto close;
+        }
+        else {
+            ret = f->type == ZSON_ARRAY ? ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            goto error;
+        }
+    element:
+        /* push the slot of the next element, or parse the key of the next member */
+        f = (zson_parse_frame*)(c->stack + frame);
+        if (f->type == ZSON_ARRAY) {
+            zson_value* a;
+            c->proj = f->proj;
+            c->schema = f->schema != NULL ? f->schema->items : NULL;
+            f->size++;
+            slot = c->top;
+            a = (zson_value*)zson_context_push(c, sizeof(zson_value));
+            zson_init(a);
+        }
+        else {
+            const zson_projection* sub = NULL;
+            const zson_schema_field* field = NULL;
+            zson_member* m;
+            const char* json = c->json;
+            char* str, *k;
+            size_t klen;
+            ZSON_TRACE_DECL(mark)
+            if (*c->json != '"') {
+                ret = ZSON_PARSE_MISS_KEY;
+                goto error;
+            }
+            ZSON_TRACE_BEGIN(ZSON_TRACE_PARSE_STRING, mark);
+            ret = zson_parse_string_raw(c, &str, &klen);
+            ZSON_TRACE_END(ZSON_TRACE_PARSE_STRING, mark, (size_t)(c->json - json));
+            if (ret != ZSON_PARSE_OK)
+                goto error;
+            f = (zson_parse_frame*)(c->stack + frame);  /* the key may have grown the stack */
+            if (f->schema != NULL)
+                field = zson_find_schema_field(f->schema, str, klen);
+            if (f->proj != NULL && (sub = zson_find_projection(f->proj, str, klen)) == NULL)
+                str = NULL; /* members outside the projection are skipped */
+            zson_parse_whitespace(c);
+            if (*c->json != ':') {
+                ret = ZSON_PARSE_MISS_COLON;
+                goto error;
+            }
+            c->json++;
+            zson_parse_whitespace(c);
+            if (str == NULL) {
+                if ((ret = zson_skip_value(c)) != ZSON_PARSE_OK)
+                    goto error;
+                goto next;
+            }
+            memcpy(k = (char*)ZSON_ALLOC(c->va, klen + 1), str, klen); /* before the push overwrites the key */
+            k[klen] = '\0';
+            c->proj = sub != NULL && !sub->all ? sub : NULL;
+            c->schema = field != NULL ? field->s : NULL;
+            f->size++;
+            slot = c->top + offsetof(zson_member, v);
+            m = (zson_member*)zson_context_push(c, sizeof(zson_member));
+            m->k = k;
+            m->klen = klen;
+            zson_init(&m->v);
+        }
+        continue;
+    close:
+        /* pop the elements or members of the innermost container into its slot */
+        f = (zson_parse_frame*)(c->stack + frame);
+        if (f->schema != NULL && f->type == ZSON_OBJECT &&
+            !zson_match_required(f->schema, (zson_member*)(f + 1), f->size)) {
+            ret = ZSON_PARSE_SCHEMA_MISMATCH;
+            goto error;
+        }
+        slot = f->slot;
+        zson_init(&e);
+        zson_close_container(c, f, &e);
+        f = (zson_parse_frame*)zson_context_pop(c, sizeof(zson_parse_frame));
+#ifdef ZSON_TRACE
+        zson_trace_end(f->type == ZSON_ARRAY ? ZSON_TRACE_PARSE_ARRAY : ZSON_TRACE_PARSE_OBJECT, f->mark, (size_t)(c->json - f->json));
+#endif
+        frame = f->prev;
+        depth--;
+        if (f->schema != NULL && !zson_match_schema(f->schema, &e)) {
+            zson_release(&e);
+            ret = ZSON_PARSE_SCHEMA_MISMATCH;
+            goto error;
+        }
+        memcpy(slot == ZSON_ROOT ? v : (zson_value*)(c->stack + slot), &e, sizeof(zson_value));
+        goto next;
+    }
+error:
+    /* Pop and free values and members of all open containers */
+    while (frame != ZSON_ROOT) {
+        f = (zson_parse_frame*)(c->stack + frame);
+        if (f->type == ZSON_ARRAY)
+            for (i = f->size; i > 0; i--)
+                zson_release((zson_value*)zson_context_pop(c, sizeof(zson_value)));
+        else
+            for (i = f->size; i > 0; i--) {
+                zson_member* m = (zson_member*)zson_context_pop(c, sizeof(zson_member));
+                ZSON_DEALLOC(c->va, m->k);
+                zson_release(&m->v);
+            }
+        f = (zson_parse_frame*)zson_context_pop(c, sizeof(zson_parse_frame));
+#ifdef ZSON_TRACE
+        zson_trace_end(f->type == ZSON_ARRAY ? ZSON_TRACE_PARSE_ARRAY : ZSON_TRACE_PARSE_OBJECT, f->mark, (size_t)(c->json - f->json));
+#endif
+        frame = f->prev;
+    }
+    return ret;
+}
+
+void zson_init_parse_options(zson_parse_options* options) {
+    assert(options != NULL);
+    options->projection = NULL;
+    options->max_depth = 0;
+    options->allocator = NULL;
+    options->schema = NULL;
+    options->flags = 0;
+}
+
+int zson_parse(zson_value* v, const char* json) {
+    return zson_parse_ex(v, json, NULL);
+}
+
+static int zson_parse_document(zson_context* c, zson_value* v, const char* json, const zson_parse_options* options) {
+    int ret;
+    assert(v != NULL && json != NULL);
+    c->json = json;
+    if (options != NULL) {
+        if (options->projection != NULL && !options->projection->all)
+            c->proj = options->projection;
+        if (options->max_depth != 0)
+            c->max_depth = options->max_depth;
+        if (options->allocator != NULL)
+            c->va = options->allocator;
+        c->schema = options->schema;
+        c->flags = options->flags;
+    }
+    zson_init(v);
+    zson_parse_whitespace(c);
+    if ((ret = zson_parse_value(c, v)) == ZSON_PARSE_OK) {
+        zson_parse_whitespace(c);
+        if (*c->json != '\0') {
+            zson_release(v);
+            ret = ZSON_PARSE_ROOT_NOT_SINGULAR;
+        }
+    }
+    ZSON_STAT(bytes_parsed, (size_t)(c->json - json));
+    assert(c->top == 0);
+    return ret;
+}
+
+int zson_parse_ex(zson_value* v, const char* json, const zson_parse_options* options) {
+    zson_context c;
+    int ret;
+    zson_context_init(&c, NULL, 0);
+    if (options != NULL && options->allocator != NULL)
+        c.a = options->allocator;
+    ret = zson_parse_document(&c, v, json, options);
+    zson_context_release(&c);
+    return ret;
+}
+
+/* Elements or members of the root container between two split points, parsed by one thread. */
+typedef struct {
+    zson_job job;
+    const char* json, *end;     /* first byte after the bracket or comma, closing bracket or next comma */
+    zson_type type;
+    zson_context c;             /* the parsed elements or members */
+    size_t size;
+    int ret;
+}zson_part;
+
+static void zson_parse_part(void* arg) {
+    zson_part* p = (zson_part*)arg;
+    zson_context* c = &p->c;
+    zson_member* m;
+    zson_value e;
+    char* str, *k = NULL;
+    size_t klen = 0;
+    c->json = p->json;
+    for (;;) {
+        zson_parse_whitespace(c);
+        if (p->type == ZSON_OBJECT) {
+            if (*c->json != '"') {
+                p->ret = ZSON_PARSE_MISS_KEY;
+                break;
+            }
+            if ((p->ret = zson_parse_string_raw(c, &str, &klen)) != ZSON_PARSE_OK)
+                break;
+            memcpy(k = (char*)ZSON_ALLOC(c->va, klen + 1), str, klen);  /* before a push overwrites the key */
+            k[klen] = '\0';
+            zson_parse_whitespace(c);
+            if (*c->json != ':') {
+                ZSON_DEALLOC(c->va, k);
+                p->ret = ZSON_PARSE_MISS_COLON;
+                break;
+            }
+            c->json++;
+            zson_parse_whitespace(c);
+        }
+        zson_init(&e);
+        if ((p->ret = zson_parse_value(c, &e)) != ZSON_PARSE_OK) {
+            if (p->type == ZSON_OBJECT)
+                ZSON_DEALLOC(c->va, k);
+            break;
+        }
+        if (p->type == ZSON_ARRAY)
+            memcpy(zson_context_push(c, sizeof(zson_value)), &e, sizeof(zson_value));
+        else {
+            m = (zson_member*)zson_context_push(c, sizeof(zson_member));
+            m->k = k;
+            m->klen = klen;
+            memcpy(&m->v, &e, sizeof(zson_value));
+        }
+        p->size++;
+        zson_parse_whitespace(c);
+        if (c->json == p->end)
+            return;
+        if (c->json > p->end || *c->json != ',') {
+            p->ret = ZSON_PARSE_INVALID_VALUE;  /* not where the scan split, the serial parse tells */
+            break;
+        }
+        c->json++;
+    }
+    for (; p->size > 0; p->size--) {
+        if (p->type == ZSON_ARRAY)
+            zson_release((zson_value*)zson_context_pop(c, sizeof(zson_value)));
+        else {
+            m = (zson_member*)zson_context_pop(c, sizeof(zson_member));
+            ZSON_DEALLOC(c->va, m->k);
+            zson_release(&m->v);
+        }
+    }
+}
+
+/*
+ * Quote-aware scan from just inside the root container to its closing bracket, which is returned.
+ * Commas between children of the root at or after each splits[i] target replace the target.
+ * Returns NULL when the brackets do not balance, the serial parse then reports the error.
+ */
+static const char* zson_scan_splits(const char* p, const char** splits, size_t n) {
+    size_t depth = 1, i = 0;
+    for (;; p++) {
+        switch (*p) {
+            case '"':
+                for (p++; *p != '"'; p++) {
+                    if (*p == '\0')
+                        return NULL;
+                    if (*p == '\\' && p[1] != '\0')
+                        p++;
+                }
+                break;
+            case '[': case '{': depth++; break;
+            case ']': case '}':
+                if (--depth == 0) {
+                    for (; i < n; i++)
+                        splits[i] = NULL;
+                    return p;
+                }
+                break;
+            case ',':
+                if (depth == 1 && i < n && p >= splits[i])
+                    splits[i++] = p;
+                break;
+            case '\0': return NULL;
+        }
+    }
+}
+
+/*
+ * The root container is cut at commas between its children into one part per thread. Documents that
+ * cannot be split, and any error, fall back to the serial parser so results and error codes match.
+ */
+int zson_parse_parallel(zson_value* v, const char* json, unsigned nthreads) {
+    return zson_parse_parallel_ex(v, json, nthreads, NULL);
+}
+
+int zson_parse_parallel_ex(zson_value* v, const char* json, unsigned nthreads, const zson_parse_options* options) {
+    const zson_allocator* a = options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator;
+    zson_context c;
+    zson_part* parts;
+    const char** splits, *root, *end;
+    size_t n, i, size, len;
+    unsigned packed;
+    int ret = ZSON_PARSE_OK;
+    assert(v != NULL && json != NULL);
+    zson_context_init(&c, NULL, 0);
+    c.json = json;
+    zson_parse_whitespace(&c);
+    root = c.json;
+    if (nthreads < 2 || (*root != '[' && *root != '{') ||
+        (options != NULL && ((options->projection != NULL && !options->projection->all) || options->schema != NULL)))
+        return zson_parse_ex(v, json, options);
+    len = strlen(root);
+    splits = (const char**)ZSON_ALLOC(a, (nthreads - 1) * sizeof(const char*));
+    for (i = 0; i < nthreads - 1; i++)
+        splits[i] = root + len / nthreads * (i + 1);
+    end = zson_scan_splits(root + 1, splits, nthreads - 1);
+    if (end != NULL && *end != (*root == '[' ? ']' : '}'))
+        end = NULL;  /* closed by the other kind of bracket, the serial parse reports it */
+    for (n = 1; end != NULL && n < nthreads && splits[n - 1] != NULL; n++)
+        ;
+    if (n < 2) {
+        ZSON_DEALLOC(a, splits);
+        return zson_parse_ex(v, json, options);
+    }
+    parts = (zson_part*)ZSON_ALLOC(a, n * sizeof(zson_part));
+    for (i = n; i-- > 0; ) {
+        zson_part* p = &parts[i];
+        p->json = i == 0 ? root + 1 : splits[i - 1] + 1;
+        p->end = i == n - 1 ? end : splits[i];
+        p->type = *root == '[' ? ZSON_ARRAY : ZSON_OBJECT;
+        zson_context_init(&p->c, NULL, 0);
+        p->c.a = p->c.va = a;
+        if (options != NULL) {
+            if (options->max_depth != 0)
+                p->c.max_depth = options->max_depth;
+            p->c.flags = options->flags;
+        }
+        p->c.max_depth--;  /* below the root */
+        p->size = 0;
+        p->job.run = zson_parse_part;
+        p->job.arg = p;
+        if (i > 0)
+            zson_start_job(&p->job);
+        else
+            zson_parse_part(p);
+    }
+    for (i = 1; i < n; i++)
+        zson_join_job(&parts[i].job);
+    for (i = size = 0; i < n; i++) {
+        size += parts[i].size;
+        if (parts[i].ret != ZSON_PARSE_OK)
+            ret = parts[i].ret;
+    }
+    c.json = end + 1;
+    zson_parse_whitespace(&c);
+    if (*c.json != '\0')
+        ret = ZSON_PARSE_ROOT_NOT_SINGULAR;
+    zson_init(v);
+    if (ret == ZSON_PARSE_OK) {
+        size_t slot = *root == '[' ? sizeof(zson_value) : sizeof(zson_member);
+        char* data;
+        if (*root == '[')
+            zson_alloc_array(v, size, a);
+        else
+            zson_alloc_object(v, size, a);
+        data = (char*)WALK_DATA(v);
+        for (i = 0; i < n; data += parts[i++].size * slot)
+            memcpy(data, parts[i].c.stack, parts[i].size * slot);
+        if (*root == '[')
+            v->u.a.size = size;
+        else
+            v->u.o.size = size;
+        if (*root == '[' && (parts[0].c.flags & ZSON_PARSE_PACK_ARRAYS) && (packed = zson_packable(ZSON_ELEMENTS_OF(v), size))) {
+            zson_value old;  /* the root is packed like any other array */
+            memcpy(&old, v, sizeof(zson_value));
+            zson_init(v);
+            zson_alloc_packed(v, ZSON_ELEMENTS_OF(&old), size, packed, a);
+            zson_release(&old);
+        }
+        ZSON_STAT(bytes_parsed, (size_t)(c.json - json));
+    }
+    else {
+        for (i = 0; i < n; i++) {
+            for (; parts[i].size > 0; parts[i].size--) {
+                if (*root == '[')
+                    zson_free((zson_value*)zson_context_pop(&parts[i].c, sizeof(zson_value)));
+                else {
+                    zson_member* m = (zson_member*)zson_context_pop(&parts[i].c, sizeof(zson_member));
+                    ZSON_DEALLOC(a, m->k);
+                    zson_free(&m->v);
+                }
+            }
+        }
+    }
+    for (i = 0; i < n; i++)
+        zson_context_release(&parts[i].c);
+    ZSON_DEALLOC(a, parts);
+    ZSON_DEALLOC(a, splits);
+    return ret == ZSON_PARSE_OK ? ret : zson_parse_ex(v, json, options);
+}
+
+/* Reads the rest of a stream in growing chunks, NUL-terminated. NULL on a read error. */
+static char* zson_read_stream(FILE* fp, const zson_allocator* a) {
+    size_t size = 0, capacity = 1 << 16, n;
+    char* buffer = (char*)ZSON_ALLOC(a, capacity);
+    while ((n = fread(buffer + size, 1, capacity - size - 1, fp)) > 0)
+        if ((size += n) == capacity - 1)
+            buffer = (char*)ZSON_REALLOC(a, buffer, capacity *= 2);
+    if (ferror(fp)) {
+        ZSON_DEALLOC(a, buffer);
+        return NULL;
+    }
+    buffer[size] = '\0';
+    return buffer;
+}
+
+/*
+ * Regular files are mapped and parsed in place: the zero-filled tail of the last page terminates
+ * the text, so files filling whole pages, pipes and systems without mmap() are read instead.
+ */
+int zson_parse_file(zson_value* v, const char* path, unsigned flags) {
+    zson_parse_options options;
+    zson_init_parse_options(&options);
+    options.flags = flags;
+    return zson_parse_file_ex(v, path, &options);
+}
+
+int zson_parse_file_ex(zson_value* v, const char* path, const zson_parse_options* options) {
+    const zson_allocator* a = options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator;
+    FILE* fp;
+    char* json;
+    int ret;
+#ifdef ZSON_MMAP
+    struct stat st;
+    int fd;
+    assert(v != NULL && path != NULL);
+    zson_init(v);
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return ZSON_PARSE_IO_ERROR;
+    if ((options == NULL || !(options->flags & ZSON_PARSE_FILE_READ)) && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (zson_uint64)st.st_size < (size_t)-1 && st.st_size % sysconf(_SC_PAGESIZE) != 0) {
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            close(fd);
+            posix_madvise(p, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+            ret = zson_parse_ex(v, (const char*)p, options);
+            munmap(p, (size_t)st.st_size);
+            return ret;
+        }
+    }
+    if ((fp = fdopen(fd, "rb")) == NULL) {
+        close(fd);
+        return ZSON_PARSE_IO_ERROR;
+    }
+#else
+    assert(v != NULL && path != NULL);
+    zson_init(v);
+    if ((fp = fopen(path, "rb")) == NULL)
+        return ZSON_PARSE_IO_ERROR;
+#endif
+    json = zson_read_stream(fp, a);
+    fclose(fp);
+    if (json == NULL)
+        return ZSON_PARSE_IO_ERROR;
+    ret = zson_parse_ex(v, json, options);
+    ZSON_DEALLOC(a, json);
+    return ret;
+}
+
+struct zson_parser {
+    char* stack;        /* scratch stack kept between calls */
+    size_t size;
+    zson_allocator a;   /* allocator of the parser and its stack */
+};
+
+zson_parser* zson_create_parser(void) {
+    zson_parser* p = (zson_parser*)ZSON_ALLOC(&zson_global_allocator, sizeof(zson_parser));
+    p->stack = NULL;
+    p->size = 0;
+    p->a = zson_global_allocator;
+    return p;
+}
+
+void zson_free_parser(zson_parser* p) {
+    zson_allocator a;
+    if (p == NULL)
+        return;
+    a = p->a;
+    ZSON_DEALLOC(&a, p->stack);
+    ZSON_DEALLOC(&a, p);
+}
+
+int zson_parse_with(zson_parser* p, zson_value* v, const char* json, const zson_parse_options* options) {
+    zson_context c;
+    int ret;
+    assert(p != NULL);
+    zson_context_init(&c, NULL, 0);
+    c.stack = p->stack;
+    c.size = p->size;
+    c.a = &p->a;
+    ret = zson_parse_document(&c, v, json, options);
+    p->stack = c.stack;
+    p->size = c.size;
+    return ret;
+}
+
+size_t zson_get_parser_capacity(const zson_parser* p) {
+    assert(p != NULL);
+    return p->size;
+}
+
+void zson_trim_parser(zson_parser* p, size_t capacity) {
+    assert(p != NULL);
+    if (p->size > capacity) {
+        p->size = capacity;
+        if (capacity == 0) {
+            ZSON_DEALLOC(&p->a, p->stack);
+            p->stack = NULL;
+        }
+        else
+            p->stack = (char*)ZSON_REALLOC(&p->a, p->stack, capacity);
+    }
+}
+
+static zson_projection* zson_new_projection(const zson_allocator* a) {
+    zson_projection* p = (zson_projection*)ZSON_ALLOC(a, sizeof(zson_projection));
+    p->f = NULL;
+    p->size = p->capacity = 0;
+    p->all = 0;
+    p->a = *a;
+    return p;
+}
+
+static zson_projection* zson_add_projection_field(zson_projection* p, const char* key, size_t klen) {
+    zson_projection_field* f;
+    size_t i;
+    for (i = 0; i < p->size; i++)
+        if (p->f[i].klen == klen && memcmp(p->f[i].k, key, klen) == 0)
+            return p->f[i].p;
+    if (p->size == p->capacity) {
+        p->capacity = p->capacity == 0 ? 4 : p->capacity * 2;
+        p->f = (zson_projection_field*)ZSON_REALLOC(&p->a, p->f, p->capacity * sizeof(zson_projection_field));
+    }
+    f = &p->f[p->size++];
+    memcpy(f->k = (char*)ZSON_ALLOC(&p->a, klen + 1), key, klen);
+    f->k[klen] = '\0';
+    f->klen = klen;
+    return f->p = zson_new_projection(&p->a);
+}
+
+static int zson_compare_projection_field(const void* lhs, const void* rhs) {
+    const zson_projection_field* a = (const zson_projection_field*)lhs;
+    const zson_projection_field* b = (const zson_projection_field*)rhs;
+    return zson_compare_key(a->k, a->klen, b->k, b->klen);
+}
+
+static void zson_sort_projection(zson_projection* p) {
+    size_t i;
+    if (p->size > 1)
+        qsort(p->f, p->size, sizeof(zson_projection_field), zson_compare_projection_field);
+    for (i = 0; i < p->size; i++)
+        zson_sort_projection(p->f[i].p);
+}
+
+zson_projection* zson_create_projection(const char* const* paths, size_t count) {
+    zson_projection* root;
+    char* key;
+    size_t i;
+    assert(paths != NULL || count == 0);
+    root = zson_new_projection(&zson_global_allocator);
+    for (i = 0; i < count; i++) {
+        const char* path = paths[i];
+        zson_projection* p = root;
+        assert(path != NULL);
+        if (*path != '\0' && *path != '/') {
+            zson_free_projection(root);
+            return NULL;
+        }
+        /* unescape each reference token into a scratch key, "~1" is '/' and "~0" is '~' */
+        key = (char*)ZSON_ALLOC(&root->a, strlen(path) + 1);
+        while (*path == '/') {
+            size_t klen = 0;
+            for (path++; *path != '\0' && *path != '/'; path++) {
+                if (*path == '~') {
+                    if (path[1] != '0' && path[1] != '1') {
+                        ZSON_DEALLOC(&root->a, key);
+                        zson_free_projection(root);
+                        return NULL;
+                    }
+                    key[klen++] = *++path == '0' ? '~' : '/';
+                }
+                else
+                    key[klen++] = *path;
+            }
+            p = zson_add_projection_field(p, key, klen);
+        }
+        ZSON_DEALLOC(&root->a, key);
+        p->all = 1;
+    }
+    zson_sort_projection(root);
+    return root;
+}
+
+void zson_free_projection(zson_projection* p) {
+    zson_allocator a;
+    size_t i;
+    if (p == NULL)
+        return;
+    a = p->a;
+    for (i = 0; i < p->size; i++) {
+        ZSON_DEALLOC(&a, p->f[i].k);
+        zson_free_projection(p->f[i].p);
+    }
+    ZSON_DEALLOC(&a, p->f);
+    ZSON_DEALLOC(&a, p);
+}
+
+static zson_schema* zson_new_schema(const zson_allocator* a) {
+    zson_schema* s = (zson_schema*)ZSON_ALLOC(a, sizeof(zson_schema));
+    s->types = ZSON_SCHEMA_ANY;
+    s->checks = 0;
+    s->minimum = s->maximum = 0.0;
+    s->max_length = 0;
+    s->f = NULL;
+    s->size = s->capacity = s->required = 0;
+    s->items = NULL;
+    zson_init(&s->e);
+    s->a = *a;
+    return s;
+}
+
+static zson_schema_field* zson_add_schema_field(zson_schema* s, const char* key, size_t klen) {
+    zson_schema_field* f;
+    size_t i;
+    for (i = 0; i < s->size; i++)
+        if (s->f[i].klen == klen && memcmp(s->f[i].k, key, klen) == 0)
+            return &s->f[i];
+    if (s->size == s->capacity) {
+        s->capacity = s->capacity == 0 ? 4 : s->capacity * 2;
+        s->f = (zson_schema_field*)ZSON_REALLOC(&s->a, s->f, s->capacity * sizeof(zson_schema_field));
+    }
+    f = &s->f[s->size++];
+    memcpy(f->k = (char*)ZSON_ALLOC(&s->a, klen + 1), key, klen);
+    f->k[klen] = '\0';
+    f->klen = klen;
+    f->s = NULL;
+    f->required = 0;
+    return f;
+}
+
+static int zson_compare_schema_field(const void* lhs, const void* rhs) {
+    const zson_schema_field* a = (const zson_schema_field*)lhs;
+    const zson_schema_field* b = (const zson_schema_field*)rhs;
+    return zson_compare_key(a->k, a->klen, b->k, b->klen);
+}
+
+#define KEY_IS(m, lit) ((m)->klen == sizeof(lit) - 1 && memcmp((m)->k, lit, sizeof(lit) - 1) == 0)
+
+static unsigned zson_compile_schema_type(const zson_value* v) {
+    static const char* const names[] = { "null", "boolean", "integer", "number", "string", "array", "object" };
+    unsigned i;
+    if (ZSON_TYPE_OF(v) == ZSON_STRING)
+        for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+            if (strlen(names[i]) == v->u.s.len && memcmp(names[i], ZSON_STRING_OF(v), v->u.s.len) == 0)
+                return 1u << i;  /* same order as ZSON_SCHEMA_* */
+    return 0;
+}
+
+static int zson_compile_schema(zson_schema* s, const zson_value* v) {
+    zson_value scratch;
+    size_t i, j;
+    unsigned type;
+    if (ZSON_TYPE_OF(v) != ZSON_OBJECT)
+        return 0;
+    for (i = 0; i < v->u.o.size; i++) {
+        const zson_member* m = &ZSON_MEMBERS_OF(v)[i];
+        const zson_value* w = &m->v;
+        if (KEY_IS(m, "type")) {
+            if (ZSON_TYPE_OF(w) == ZSON_ARRAY) {
+                s->types = 0;
+                for (j = 0; j < w->u.a.size; j++) {
+                    if ((type = zson_compile_schema_type(zson_array_element(w, j, &scratch))) == 0)
+                        return 0;
+                    s->types |= type;
+                }
+            }
+            else if ((s->types = zson_compile_schema_type(w)) == 0)
+                return 0;
+        }
+        else if (KEY_IS(m, "enum")) {
+            if (ZSON_TYPE_OF(w) != ZSON_ARRAY)
+                return 0;
+            zson_copy(&s->e, w);
+        }
+        else if (KEY_IS(m, "minimum")) {
+            if (ZSON_TYPE_OF(w) != ZSON_NUMBER)
+                return 0;
+            s->minimum = zson_get_number(w);
+            s->checks |= ZSON_SCHEMA_MINIMUM;
+        }
+        else if (KEY_IS(m, "maximum")) {
+            if (ZSON_TYPE_OF(w) != ZSON_NUMBER)
+                return 0;
+            s->maximum = zson_get_number(w);
+            s->checks |= ZSON_SCHEMA_MAXIMUM;
+        }
+        else if (KEY_IS(m, "maxLength")) {
+            if (ZSON_TYPE_OF(w) != ZSON_NUMBER || !(zson_schema_type(w) & ZSON_SCHEMA_INTEGER) || zson_get_number(w) < 0)
+                return 0;
+            s->max_length = (size_t)zson_get_uint64(w);
+            s->checks |= ZSON_SCHEMA_MAX_LENGTH;
+        }
+        else if (KEY_IS(m, "required")) {
+            if (ZSON_TYPE_OF(w) != ZSON_ARRAY)
+                return 0;
+            for (j = 0; j < w->u.a.size; j++) {
+                zson_schema_field* f;
+                if (ZSON_TYPE_OF(zson_array_element(w, j, &scratch)) != ZSON_STRING)
+                    return 0;
+                f = zson_add_schema_field(s, ZSON_STRING_OF(&ZSON_ELEMENTS_OF(w)[j]), ZSON_ELEMENTS_OF(w)[j].u.s.len);
+                if (!f->required) {
+                    f->required = 1;
+                    s->required++;
+                }
+            }
+        }
+        else if (KEY_IS(m, "properties")) {
+            if (ZSON_TYPE_OF(w) != ZSON_OBJECT)
+                return 0;
+            for (j = 0; j < w->u.o.size; j++) {
+                zson_schema_field* f = zson_add_schema_field(s, ZSON_MEMBERS_OF(w)[j].k, ZSON_MEMBERS_OF(w)[j].klen);
+                if (f->s != NULL || !zson_compile_schema(f->s = zson_new_schema(&s->a), &ZSON_MEMBERS_OF(w)[j].v))
+                    return 0;
+            }
+        }
+        else if (KEY_IS(m, "items")) {
+            if (s->items != NULL || !zson_compile_schema(s->items = zson_new_schema(&s->a), w))
+                return 0;
+        }
+        else if (!KEY_IS(m, "$schema") && !KEY_IS(m, "$id") && !KEY_IS(m, "$comment") && !KEY_IS(m, "title") &&
+                 !KEY_IS(m, "description") && !KEY_IS(m, "default") && !KEY_IS(m, "examples"))
+            return 0;
+    }
+    if (s->size > 1)
+        qsort(s->f, s->size, sizeof(zson_schema_field), zson_compare_schema_field);
+    return 1;
+}
+
+#undef KEY_IS
+
+zson_schema* zson_create_schema(const zson_value* schema) {
+    zson_schema* s;
+    assert(schema != NULL);
+    s = zson_new_schema(&zson_global_allocator);
+    if (!zson_compile_schema(s, schema)) {
+        zson_free_schema(s);
+        return NULL;
+    }
+    return s;
+}
+
+void zson_free_schema(zson_schema* s) {
+    zson_allocator a;
+    size_t i;
+    if (s == NULL)
+        return;
+    a = s->a;
+    for (i = 0; i < s->size; i++) {
+        ZSON_DEALLOC(&a, s->f[i].k);
+        zson_free_schema(s->f[i].s);
+    }
+    ZSON_DEALLOC(&a, s->f);
+    zson_free_schema(s->items);
+    zson_release(&s->e);
+    ZSON_DEALLOC(&a, s);
+}
+
+/* Length of the leading run that can be copied verbatim: no '"', '\\' or control character, and no non-ASCII byte in ASCII mode. */
+static size_t zson_scan_unescaped(const char* s, size_t len, unsigned flags) {
+    int ascii = (flags & ZSON_STRINGIFY_ASCII) != 0;
+    size_t i = 0;
+#ifdef ZSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\'), control = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(x, control), control)); /* x <= 0x1F */
+        unsigned mask = (unsigned)_mm_movemask_epi8(m);
+        if (ascii)
+            mask |= (unsigned)_mm_movemask_epi8(x);
+        if (mask != 0)
+            return i + zson_ctz(mask);
+    }
+#endif
+    for (; i < len; i++) {
+        unsigned char ch = (unsigned char)s[i];
+        if (ch == '"' || ch == '\\' || ch < 0x20 || (ascii && ch >= 0x80))
+            break;
+    }
+    return i;
+}
+
+static char* zson_put_unicode_escape(char* p, unsigned u) {
+    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+    *p++ = '\\'; *p++ = 'u';
+    *p++ = hex_digits[(u >> 12) & 15];
+    *p++ = hex_digits[(u >>  8) & 15];
+    *p++ = hex_digits[(u >>  4) & 15];
+    *p++ = hex_digits[ u        & 15];
+    return p;
+}
+
+/* Write the escape sequence of the character at s into out, return its length and the input bytes consumed in n. */
+static size_t zson_escape_char(const char* s, size_t len, char* out, size_t* n) {
+    unsigned u = (unsigned char)*s;
+    char* p = out;
+    *n = 1;
+    switch (u) {
+        case '\"': *p++ = '\\'; *p++ = '\"'; return 2;
+        case '\\': *p++ = '\\'; *p++ = '\\'; return 2;
+        case '\b': *p++ = '\\'; *p++ = 'b';  return 2;
+        case '\f': *p++ = '\\'; *p++ = 'f';  return 2;
+        case '\n': *p++ = '\\'; *p++ = 'n';  return 2;
+        case '\r': *p++ = '\\'; *p++ = 'r';  return 2;
+        case '\t': *p++ = '\\'; *p++ = 't';  return 2;
+    }
+    if (u >= 0x80)
+        u = zson_decode_utf8((const unsigned char*)s, len, n);
+    if (u >= 0x10000) { /* surrogate pair */
+        p = zson_put_unicode_escape(p, 0xD800 | ((u - 0x10000) >> 10));
+        u = 0xDC00 | ((u - 0x10000) & 0x3FF);
+    }
+    p = zson_put_unicode_escape(p, u);
+    return p - out;
+}
+
+static size_t zson_stringify_string_size(const char* s, size_t len, unsigned flags) {
+    size_t i = 0, n, size = len + 2;
+    char escape[12];
+    while ((i += zson_scan_unescaped(s + i, len - i, flags)) < len) {
+        size += zson_escape_char(s + i, len - i, escape, &n) - n;
+        i += n;
+    }
+    return size;
+}
+
+/* Reserve len + 2 bytes up front and grow only when an escape is longer than its input, so plain strings are scanned once. */
+static void zson_stringify_string(zson_context* c, const char* s, size_t len) {
+    size_t i = 0, j, n, e, head = c->top, offset;
+    char escape[12], *p;
+    ZSON_TRACE_DECL(mark)
+    assert(s != NULL);
+    ZSON_TRACE_BEGIN(ZSON_TRACE_STRINGIFY_STRING, mark);
+    p = zson_context_push(c, len + 2);
+    *p++ = '"';
+    while (i < len) {
+        j = zson_scan_unescaped(s + i, len - i, c->flags);
+        memcpy(p, s + i, j);
+        p += j;
+        if ((i += j) < len) {
+            e = zson_escape_char(s + i, len - i, escape, &n);
+            offset = p - c->stack;
+            if (e > n)
+                zson_context_push(c, e - n);
+            p = c->stack + offset;
+            memcpy(p, escape, e);
+            p += e;
+            i += n;
+            ZSON_TRACE_COUNT(escapes_emitted);
+        }
+    }
+    *p++ = '"';
+    assert(p == c->stack + c->top);
+    ZSON_TRACE_END(ZSON_TRACE_STRINGIFY_STRING, mark, c->top - head);
+}
+
+/* Format a number into buffer (at least 32 bytes), integers skip sprintf(). */
+static size_t zson_format_number(char* buffer, const zson_value* v) {
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[24], *p = tmp + sizeof(tmp);
+    zson_uint64 u;
+    size_t len;
+    if (!(ZSON_FLAGS_OF(v) & ZSON_INTEGER))
+        return sprintf(buffer, "%.17g", ZSON_NUMBER_OF(v));
+    u = (ZSON_FLAGS_OF(v) & ZSON_UINT64) || v->u.i >= 0 ? v->u.ui : 0 - v->u.ui;
+    while (u >= 100) {
+        const char* d = digit_pairs + (u % 100) * 2;
+        u /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (u >= 10) {
+        *--p = digit_pairs[u * 2 + 1];
+        *--p = digit_pairs[u * 2];
+    }
+    else
+        *--p = (char)('0' + u);
+    if ((ZSON_FLAGS_OF(v) & ZSON_INT64) && v->u.i < 0)
+        *--p = '-';
+    memcpy(buffer, p, len = tmp + sizeof(tmp) - p);
+    return len;
+}
+
+static void zson_stringify_value(zson_context* c, const zson_value* v) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    zson_value scratch;
+    size_t head = c->top, n;
+    char buffer[32];
+    ZSON_TRACE_DECL(mark)
+    zson_context_init(&s, local, sizeof(local));
+    s.a = c->a;
+    for (;;) {
+        switch (ZSON_TYPE_OF(v)) {
+            case ZSON_NULL:   PUTS(c, "null",  4); break;
+            case ZSON_FALSE:  PUTS(c, "false", 5); break;
+            case ZSON_TRUE:   PUTS(c, "true",  4); break;
+            case ZSON_NUMBER:
+                ZSON_TRACE_BEGIN(ZSON_TRACE_STRINGIFY_NUMBER, mark);
+                n = zson_format_number(buffer, v);
+                PUTS(c, buffer, n);
+                ZSON_TRACE_END(ZSON_TRACE_STRINGIFY_NUMBER, mark, n);
+                break;
+            case ZSON_STRING: zson_stringify_string(c, ZSON_STRING_OF(v), v->u.s.len); break;
+            case ZSON_ARRAY:  PUTC(c, '['); zson_walk_push(&s, v, NULL); break;
+            case ZSON_OBJECT: PUTC(c, '{'); zson_walk_push(&s, v, NULL); break;
+            default: assert(0 && "invalid type");
+        }
+#ifdef ZSON_TRACE
+        if (ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT) {
+            f = WALK_TOP(&s);
+            f->head = c->top - 1;
+            zson_trace_begin(ZSON_TYPE_OF(v) == ZSON_ARRAY ? ZSON_TRACE_STRINGIFY_ARRAY : ZSON_TRACE_STRINGIFY_OBJECT, &f->mark);
+        }
+#endif
+        /* move on to the next child, closing finished containers */
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                ZSON_STAT(bytes_emitted, c->top - head);
+                return;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            PUTC(c, ZSON_TYPE_OF(f->v) == ZSON_ARRAY ? ']' : '}');
+#ifdef ZSON_TRACE
+            zson_trace_end(ZSON_TYPE_OF(f->v) == ZSON_ARRAY ? ZSON_TRACE_STRINGIFY_ARRAY : ZSON_TRACE_STRINGIFY_OBJECT, f->mark, c->top - f->head);
+#endif
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (f->i > 0)
+            PUTC(c, ',');
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY)
+            v = zson_array_element(f->v, f->i++, &scratch);
+        else {
+            zson_stringify_string(c, ZSON_MEMBERS_OF(f->v)[f->i].k, ZSON_MEMBERS_OF(f->v)[f->i].klen);
+            PUTC(c, ':');
+            v = &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+        }
+    }
+}
+
+void zson_init_stringify_options(zson_stringify_options* options) {
+    assert(options != NULL);
+    options->flags = 0;
+    options->allocator = NULL;
+}
+
+char* zson_stringify(const zson_value* v, size_t* length) {
+    return zson_stringify_ex(v, length, NULL);
+}
+
+char* zson_stringify_ex(const zson_value* v, size_t* length, const zson_stringify_options* options) {
+    zson_context c;
     assert(v != NULL);
+    zson_context_init(&c, NULL, 0);
+    if (options != NULL) {
+        c.flags = options->flags;
+        if (options->allocator != NULL)
+            c.a = options->allocator;
+    }
+    c.stack = (char*)ZSON_ALLOC(c.a, c.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
+    zson_stringify_value(&c, v);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+/* Consecutive children of the container split by zson_stringify_parallel(). */
+typedef struct {
+    zson_job job;
+    const zson_value* v;
+    size_t lo, hi;
+    zson_context* c;    /* output, the caller's context for the first chunk */
+    zson_context own;
+}zson_chunk;
+
+static void zson_stringify_chunk(void* arg) {
+    zson_chunk* k = (zson_chunk*)arg;
+    zson_value scratch;
+    size_t i;
+    for (i = k->lo; i < k->hi; i++) {
+        if (i > 0)
+            PUTC(k->c, ',');
+        if (ZSON_TYPE_OF(k->v) == ZSON_ARRAY)
+            zson_stringify_value(k->c, zson_array_element(k->v, i, &scratch));
+        else {
+            zson_stringify_string(k->c, ZSON_MEMBERS_OF(k->v)[i].k, ZSON_MEMBERS_OF(k->v)[i].klen);
+            PUTC(k->c, ':');
+            zson_stringify_value(k->c, &ZSON_MEMBERS_OF(k->v)[i].v);
+        }
+    }
+}
+
+/*
+ * Splits the children of the root, or of the container below a chain of single-child containers,
+ * into one chunk per thread. Chunks are written into their own buffers and appended in order.
+ */
+char* zson_stringify_parallel(const zson_value* v, size_t* length, unsigned nthreads) {
+    return zson_stringify_parallel_ex(v, length, nthreads, NULL);
+}
+
+char* zson_stringify_parallel_ex(const zson_value* v, size_t* length, unsigned nthreads, const zson_stringify_options* options) {
+    zson_context c, closing;
+    zson_chunk* chunks;
+    size_t n, i, size, per;
+#ifdef ZSON_STATS
+    size_t emitted = zson_thread_stats.bytes_emitted;
+#endif
+    assert(v != NULL);
+    zson_context_init(&c, NULL, 0);
+    zson_context_init(&closing, NULL, 0);
+    if (options != NULL) {
+        c.flags = options->flags;
+        if (options->allocator != NULL)
+            c.a = closing.a = options->allocator;
+    }
+    c.stack = (char*)ZSON_ALLOC(c.a, c.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
+    while ((ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT) && WALK_SIZE(v) == 1) {
+        const zson_value* child = ZSON_TYPE_OF(v) == ZSON_ARRAY ? &ZSON_ELEMENTS_OF(v)[0] : &ZSON_MEMBERS_OF(v)[0].v;
+        if ((ZSON_FLAGS_OF(v) & ZSON_PACKED) || (ZSON_TYPE_OF(child) != ZSON_ARRAY && ZSON_TYPE_OF(child) != ZSON_OBJECT))
+            break;
+        PUTC(&c, ZSON_TYPE_OF(v) == ZSON_ARRAY ? '[' : '{');
+        PUTC(&closing, ZSON_TYPE_OF(v) == ZSON_ARRAY ? ']' : '}');
+        if (ZSON_TYPE_OF(v) == ZSON_OBJECT) {
+            zson_stringify_string(&c, ZSON_MEMBERS_OF(v)[0].k, ZSON_MEMBERS_OF(v)[0].klen);
+            PUTC(&c, ':');
+        }
+        v = child;
+    }
+    size = ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT ? WALK_SIZE(v) : 0;
+    if ((n = nthreads < size ? nthreads : size) < 2)
+        zson_stringify_value(&c, v);
+    else {
+        PUTC(&c, ZSON_TYPE_OF(v) == ZSON_ARRAY ? '[' : '{');
+        chunks = (zson_chunk*)ZSON_ALLOC(c.a, n * sizeof(zson_chunk));
+        per = size / n;
+        for (i = n; i-- > 0; ) {
+            zson_chunk* k = &chunks[i];
+            k->v = v;
+            k->lo = i * per;
+            k->hi = i == n - 1 ? size : k->lo + per;
+            if (i > 0) {
+                zson_context_init(&k->own, NULL, 0);
+                k->own.a = c.a;
+                k->own.flags = c.flags;
+                k->own.stack = (char*)ZSON_ALLOC(k->own.a, k->own.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
+                k->c = &k->own;
+            }
+            else
+                k->c = &c;
+            k->job.run = zson_stringify_chunk;
+            k->job.arg = k;
+            if (i > 0)
+                zson_start_job(&k->job);
+            else
+                zson_stringify_chunk(k);
+        }
+        for (i = 1; i < n; i++) {
+            zson_join_job(&chunks[i].job);
+            PUTS(&c, chunks[i].own.stack, chunks[i].own.top);
+            zson_context_release(&chunks[i].own);
+        }
+        ZSON_DEALLOC(c.a, chunks);
+        PUTC(&c, ZSON_TYPE_OF(v) == ZSON_ARRAY ? ']' : '}');
+    }
+    while (closing.top > 0)
+        PUTC(&c, *(char*)zson_context_pop(&closing, sizeof(char)));
+    zson_context_release(&closing);
+#ifdef ZSON_STATS
+    zson_thread_stats.bytes_emitted = emitted + c.top;  /* the whole output once, whichever thread wrote it */
+#endif
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+struct zson_writer {
+    char* stack;        /* output buffer kept between calls */
+    size_t size;
+    zson_allocator a;   /* allocator of the writer and its buffer */
+};
+
+zson_writer* zson_create_writer(void) {
+    zson_writer* w = (zson_writer*)ZSON_ALLOC(&zson_global_allocator, sizeof(zson_writer));
+    w->stack = NULL;
+    w->size = 0;
+    w->a = zson_global_allocator;
+    return w;
+}
+
+void zson_free_writer(zson_writer* w) {
+    zson_allocator a;
+    if (w == NULL)
+        return;
+    a = w->a;
+    ZSON_DEALLOC(&a, w->stack);
+    ZSON_DEALLOC(&a, w);
+}
+
+const char* zson_stringify_with(zson_writer* w, const zson_value* v, size_t* length, const zson_stringify_options* options) {
+    zson_context c;
+    assert(w != NULL && v != NULL);
+    zson_context_init(&c, NULL, 0);
+    c.stack = w->stack;
+    c.size = w->size;
+    c.a = &w->a;
+    c.flags = options != NULL ? options->flags : 0;
+    zson_stringify_value(&c, v);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    w->stack = c.stack;
+    w->size = c.size;
+    return c.stack;
+}
+
+size_t zson_get_writer_capacity(const zson_writer* w) {
+    assert(w != NULL);
+    return w->size;
+}
+
+void zson_trim_writer(zson_writer* w, size_t capacity) {
+    assert(w != NULL);
+    if (w->size > capacity) {
+        w->size = capacity;
+        if (capacity == 0) {
+            ZSON_DEALLOC(&w->a, w->stack);
+            w->stack = NULL;
+        }
+        else
+            w->stack = (char*)ZSON_REALLOC(&w->a, w->stack, capacity);
+    }
+}
+
+static size_t zson_stringify_value_size(const zson_value* v, unsigned flags) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    zson_value scratch;
+    size_t size = 0;
+    char buffer[32];
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        switch (ZSON_TYPE_OF(v)) {
+            case ZSON_NULL:   size += 4; break;
+            case ZSON_FALSE:  size += 5; break;
+            case ZSON_TRUE:   size += 4; break;
+            case ZSON_NUMBER: size += zson_format_number(buffer, v); break;
+            case ZSON_STRING: size += zson_stringify_string_size(ZSON_STRING_OF(v), v->u.s.len, flags); break;
+            case ZSON_ARRAY:
+                size += v->u.a.size > 0 ? v->u.a.size + 1 : 2; /* brackets and commas */
+                zson_walk_push(&s, v, NULL);
+                break;
+            case ZSON_OBJECT:
+                size += v->u.o.size > 0 ? v->u.o.size * 2 + 1 : 2; /* braces, colons and commas */
+                zson_walk_push(&s, v, NULL);
+                break;
+            default: assert(0 && "invalid type");
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return size;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY)
+            v = zson_array_element(f->v, f->i++, &scratch);
+        else {
+            size += zson_stringify_string_size(ZSON_MEMBERS_OF(f->v)[f->i].k, ZSON_MEMBERS_OF(f->v)[f->i].klen, flags);
+            v = &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+        }
+    }
+}
+
+size_t zson_stringify_size(const zson_value* v) {
+    return zson_stringify_size_ex(v, NULL);
+}
+
+size_t zson_stringify_size_ex(const zson_value* v, const zson_stringify_options* options) {
+    assert(v != NULL);
+    return zson_stringify_value_size(v, options != NULL ? options->flags : 0);
+}
+
+size_t zson_stringify_into(const zson_value* v, char* buffer, size_t capacity) {
+    return zson_stringify_into_ex(v, buffer, capacity, NULL);
+}
+
+size_t zson_stringify_into_ex(const zson_value* v, char* buffer, size_t capacity, const zson_stringify_options* options) {
+    zson_context c;
+    size_t length;
+    assert(v != NULL && (buffer != NULL || capacity == 0));
+    zson_context_init(&c, buffer, capacity);
+    c.flags = options != NULL ? options->flags : 0;
+    if ((length = zson_stringify_value_size(v, c.flags)) >= capacity)
+        return length;
+    zson_stringify_value(&c, v);
+    assert(c.top == length && c.stack == buffer);
+    buffer[length] = '\0';
+    return length;
+}
+
+/* Integral numbers within the zson_int64 range, whether they were parsed as integers or not. */
+static int zson_get_exact_int64(const zson_value* v, zson_int64* i) {
+    if (ZSON_FLAGS_OF(v) & ZSON_INTEGER) {
+        *i = v->u.i;
+        return (ZSON_FLAGS_OF(v) & ZSON_INT64) != 0;
+    }
+    if (ZSON_NUMBER_OF(v) >= -9223372036854775808.0 && ZSON_NUMBER_OF(v) < 9223372036854775808.0 && ZSON_NUMBER_OF(v) == (double)(zson_int64)ZSON_NUMBER_OF(v)) {
+        *i = (zson_int64)ZSON_NUMBER_OF(v);
+        return 1;
+    }
+    return 0;
+}
+
+static const zson_field* zson_find_field(const zson_field* fields, const char* key, size_t klen) {
+    for (; fields->key != NULL; fields++)
+        if (strlen(fields->key) == klen && memcmp(fields->key, key, klen) == 0)
+            return fields;
+    return NULL;
+}
+
+static int zson_parse_fields(zson_context* c, char* obj, const zson_field* fields);
+
+static int zson_parse_field(zson_context* c, char* p, const zson_field* f) {
+    zson_value v;
+    zson_int64 i;
+    char* s;
+    size_t len;
+    int ret;
+    if (f->type == ZSON_FIELD_OBJECT)
+        return zson_parse_fields(c, p, f->fields);
+    if (f->type == ZSON_FIELD_STRING && *c->json == '"') {
+        if ((ret = zson_parse_string_raw(c, &s, &len)) != ZSON_PARSE_OK)
+            return ret;
+        ZSON_DEALLOC(c->va, *(char**)p);
+        memcpy(*(char**)p = (char*)ZSON_ALLOC(c->va, len + 1), s, len);
+        (*(char**)p)[len] = '\0';
+        return ZSON_PARSE_OK;
+    }
+    if (*c->json == '"' || *c->json == '[' || *c->json == '{')
+        return ZSON_PARSE_SCHEMA_MISMATCH;
+    zson_init(&v);
+    if ((ret = zson_parse_scalar(c, &v)) != ZSON_PARSE_OK)
+        return ret;
+    switch (f->type) {
+        case ZSON_FIELD_BOOLEAN:
+            if (ZSON_TYPE_OF(&v) != ZSON_TRUE && ZSON_TYPE_OF(&v) != ZSON_FALSE)
+                return ZSON_PARSE_SCHEMA_MISMATCH;
+            *(int*)p = ZSON_TYPE_OF(&v) == ZSON_TRUE;
+            break;
+        case ZSON_FIELD_INT:
+        case ZSON_FIELD_INT64:
+            if (ZSON_TYPE_OF(&v) != ZSON_NUMBER || !zson_get_exact_int64(&v, &i) ||
+                (f->type == ZSON_FIELD_INT && (i < INT_MIN || i > INT_MAX)))
+                return ZSON_PARSE_SCHEMA_MISMATCH;
+            if (f->type == ZSON_FIELD_INT)
+                *(int*)p = (int)i;
+            else
+                *(zson_int64*)p = i;
+            break;
+        case ZSON_FIELD_DOUBLE:
+            if (ZSON_TYPE_OF(&v) != ZSON_NUMBER)
+                return ZSON_PARSE_SCHEMA_MISMATCH;
+            *(double*)p = zson_get_number(&v);
+            break;
+        case ZSON_FIELD_STRING:
+            if (ZSON_TYPE_OF(&v) != ZSON_NULL)
+                return ZSON_PARSE_SCHEMA_MISMATCH;
+            ZSON_DEALLOC(c->va, *(char**)p);
+            *(char**)p = NULL;
+            break;
+        default: assert(0 && "invalid field type");
+    }
+    return ZSON_PARSE_OK;
+}
+
+/* Descriptor tables are finite, so recursing along them is bounded; other values are skipped. */
+static int zson_parse_fields(zson_context* c, char* obj, const zson_field* fields) {
+    const zson_field* f;
+    char* str;
+    size_t klen;
+    int ret;
+    if (*c->json != '{')
+        return *c->json == '\0' ? ZSON_PARSE_EXPECT_VALUE : ZSON_PARSE_SCHEMA_MISMATCH;
+    c->json++;
+    zson_parse_whitespace(c);
+    if (*c->json == '}') {
+        c->json++;
+        return ZSON_PARSE_OK;
+    }
+    for (;;) {
+        if (*c->json != '"')
+            return ZSON_PARSE_MISS_KEY;
+        if ((ret = zson_parse_string_raw(c, &str, &klen)) != ZSON_PARSE_OK)
+            return ret;
+        f = zson_find_field(fields, str, klen);
+        zson_parse_whitespace(c);
+        if (*c->json != ':')
+            return ZSON_PARSE_MISS_COLON;
+        c->json++;
+        zson_parse_whitespace(c);
+        if ((ret = f != NULL ? zson_parse_field(c, obj + f->offset, f) : zson_skip_value(c)) != ZSON_PARSE_OK)
+            return ret;
+        zson_parse_whitespace(c);
+        if (*c->json == ',') {
+            c->json++;
+            zson_parse_whitespace(c);
+        }
+        else if (*c->json == '}') {
+            c->json++;
+            return ZSON_PARSE_OK;
+        }
+        else
+            return ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+    }
+}
+
+int zson_parse_struct(void* obj, const zson_field* fields, const char* json) {
+    return zson_parse_struct_ex(obj, fields, json, NULL);
+}
+
+int zson_parse_struct_ex(void* obj, const zson_field* fields, const char* json, const zson_parse_options* options) {
+    zson_context c;
+    int ret;
+    assert(obj != NULL && fields != NULL && json != NULL);
+    zson_context_init(&c, NULL, 0);
+    if (options != NULL) {
+        if (options->allocator != NULL)
+            c.a = c.va = options->allocator;
+        c.flags = options->flags;
+    }
     c.json = json;
-    c.stack = NULL;
-    c.size = c.top = 0;
-    zson_init(v);
     zson_parse_whitespace(&c);
-    if ((ret = zson_parse_value(&c, v)) == ZSON_PARSE_OK) {
+    if ((ret = zson_parse_fields(&c, (char*)obj, fields)) == ZSON_PARSE_OK) {
         zson_parse_whitespace(&c);
-        if (*c.json != '\0') {
-            v->type = ZSON_NULL;
+        if (*c.json != '\0')
             ret = ZSON_PARSE_ROOT_NOT_SINGULAR;
+    }
+    ZSON_STAT(bytes_parsed, (size_t)(c.json - json));
+    zson_context_release(&c);
+    return ret;
+}
+
+static void zson_stringify_fields(zson_context* c, const char* obj, const zson_field* fields) {
+    const zson_field* f;
+    zson_value v;
+    char buffer[32];
+    PUTC(c, '{');
+    for (f = fields; f->key != NULL; f++) {
+        const char* p = obj + f->offset;
+        if (f != fields)
+            PUTC(c, ',');
+        zson_stringify_string(c, f->key, strlen(f->key));
+        PUTC(c, ':');
+        switch (f->type) {
+            case ZSON_FIELD_BOOLEAN:
+                if (*(const int*)p)
+                    PUTS(c, "true", 4);
+                else
+                    PUTS(c, "false", 5);
+                break;
+            case ZSON_FIELD_INT:
+            case ZSON_FIELD_INT64:
+            case ZSON_FIELD_DOUBLE:
+                if (f->type == ZSON_FIELD_DOUBLE)
+                    ZSON_SET_DOUBLE(&v, *(const double*)p);
+                else
+                    ZSON_SET_INT64(&v, f->type == ZSON_FIELD_INT ? *(const int*)p : *(const zson_int64*)p);
+                PUTS(c, buffer, zson_format_number(buffer, &v));
+                break;
+            case ZSON_FIELD_STRING:
+                if (*(char* const*)p != NULL)
+                    zson_stringify_string(c, *(char* const*)p, strlen(*(char* const*)p));
+                else
+                    PUTS(c, "null", 4);
+                break;
+            case ZSON_FIELD_OBJECT:
+                zson_stringify_fields(c, p, f->fields);
+                break;
+            default: assert(0 && "invalid field type");
+        }
+    }
+    PUTC(c, '}');
+}
+
+char* zson_stringify_struct(const void* obj, const zson_field* fields, size_t* length) {
+    return zson_stringify_struct_ex(obj, fields, length, NULL);
+}
+
+char* zson_stringify_struct_ex(const void* obj, const zson_field* fields, size_t* length, const zson_stringify_options* options) {
+    zson_context c;
+    assert(obj != NULL && fields != NULL);
+    zson_context_init(&c, NULL, 0);
+    if (options != NULL) {
+        c.flags = options->flags;
+        if (options->allocator != NULL)
+            c.a = options->allocator;
+    }
+    c.stack = (char*)ZSON_ALLOC(c.a, c.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
+    zson_stringify_fields(&c, (const char*)obj, fields);
+    ZSON_STAT(bytes_emitted, c.top);
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+void zson_free_struct(void* obj, const zson_field* fields) {
+    zson_free_struct_ex(obj, fields, NULL);
+}
+
+void zson_free_struct_ex(void* obj, const zson_field* fields, const zson_parse_options* options) {
+    const zson_allocator* a = options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator;
+    const zson_field* f;
+    assert(obj != NULL && fields != NULL);
+    for (f = fields; f->key != NULL; f++) {
+        char* p = (char*)obj + f->offset;
+        if (f->type == ZSON_FIELD_STRING) {
+            ZSON_DEALLOC(a, *(char**)p);
+            *(char**)p = NULL;
+        }
+        else if (f->type == ZSON_FIELD_OBJECT)
+            zson_free_struct_ex(p, f->fields, options);
+    }
+}
+
+void zson_copy(zson_value* dst, const zson_value* src) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    const zson_allocator* a;
+    zson_context s;
+    size_t i, n;
+    assert(src != NULL && dst != NULL && src != dst);
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        /* containers are allocated here, their children are copied as the walk visits them */
+        a = zson_value_allocator(src);
+        switch (ZSON_TYPE_OF(src)) {
+            case ZSON_STRING:
+                zson_alloc_string(dst, ZSON_STRING_OF(src), src->u.s.len, a);
+                break;
+            case ZSON_ARRAY:
+                if (ZSON_FLAGS_OF(src) & ZSON_PACKED) {
+                    n = (ZSON_FLAGS_OF(src) & ZSON_PACKED_INT64 ? sizeof(zson_int64) : sizeof(double)) * src->u.a.size;
+                    zson_alloc_array(dst, 0, a);
+                    ZSON_SET_FLAGS(dst, ZSON_FLAGS_OF(src) & ZSON_PACKED);
+                    ZSON_SET_DATA(dst, zson_block_alloc(a, n));
+                    memcpy(ZSON_ELEMENTS_OF(dst), ZSON_ELEMENTS_OF(src), n);
+                    dst->u.a.size = src->u.a.size;
+                    zson_set_capacity(dst, src->u.a.size);
+                    break;
+                }
+                zson_alloc_array(dst, src->u.a.size, a);
+                for (i = 0; i < src->u.a.size; i++)
+                    zson_init(&ZSON_ELEMENTS_OF(dst)[i]);
+                dst->u.a.size = src->u.a.size;
+                zson_walk_push(&s, src, dst);
+                break;
+            case ZSON_OBJECT:
+                zson_alloc_object(dst, src->u.o.size, a);
+                for (i = 0; i < src->u.o.size; i++) {
+                    zson_member* m = &ZSON_MEMBERS_OF(dst)[i];
+                    memcpy(m->k = (char*)ZSON_ALLOC(a, ZSON_MEMBERS_OF(src)[i].klen + 1), ZSON_MEMBERS_OF(src)[i].k, ZSON_MEMBERS_OF(src)[i].klen + 1);
+                    m->klen = ZSON_MEMBERS_OF(src)[i].klen;
+                    zson_init(&m->v);
+                }
+                dst->u.o.size = src->u.o.size;
+                zson_walk_push(&s, src, dst);
+                break;
+            default:
+                zson_free(dst);
+                memcpy(dst, src, sizeof(zson_value));
+                break;
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY) {
+            src = &ZSON_ELEMENTS_OF(f->v)[f->i];
+            dst = (zson_value*)&ZSON_ELEMENTS_OF(f->w)[f->i++];
+        }
+        else {
+            src = &ZSON_MEMBERS_OF(f->v)[f->i].v;
+            dst = (zson_value*)&ZSON_MEMBERS_OF(f->w)[f->i++].v;
+        }
+    }
+}
+
+void zson_copy_shared(zson_value* dst, const zson_value* src) {
+    zson_value temp;
+    assert(src != NULL && dst != NULL && src != dst);
+    memcpy(&temp, src, sizeof(zson_value));
+    zson_ref_value(&temp);
+    zson_free(dst);
+    memcpy(dst, &temp, sizeof(zson_value));
+}
+
+void zson_move(zson_value* dst, zson_value* src) {
+    assert(dst != NULL && src != NULL && src != dst);
+    zson_free(dst);
+    memcpy(dst, src, sizeof(zson_value));
+    zson_init(src);
+}
+
+void zson_swap(zson_value* lhs, zson_value* rhs) {
+    assert(lhs != NULL && rhs != NULL);
+    if (lhs != rhs) {
+        zson_value temp;
+        memcpy(&temp, lhs, sizeof(zson_value));
+        memcpy(lhs,   rhs, sizeof(zson_value));
+        memcpy(rhs, &temp, sizeof(zson_value));
+    }
+}
+
+/* Stable merge sort of the members by key, so the first of duplicate keys is still the one found. */
+static void zson_sort_members(zson_member* m, size_t n) {
+    zson_member* t;
+    size_t width, i;
+    for (i = 1; i < n; i++)
+        if (zson_compare_key(m[i - 1].k, m[i - 1].klen, m[i].k, m[i].klen) > 0)
+            break;
+    if (i >= n)
+        return;
+    t = (zson_member*)ZSON_ALLOC(&zson_global_allocator, n * sizeof(zson_member));
+    for (width = 1; width < n; width *= 2) {
+        for (i = 0; i < n; i += 2 * width) {
+            size_t mid = i + width < n ? i + width : n, hi = i + 2 * width < n ? i + 2 * width : n;
+            size_t l = i, r = mid, k = i;
+            while (l < mid && r < hi)
+                t[k++] = zson_compare_key(m[r].k, m[r].klen, m[l].k, m[l].klen) < 0 ? m[r++] : m[l++];
+            while (l < mid)
+                t[k++] = m[l++];
+            while (r < hi)
+                t[k++] = m[r++];
+        }
+        memcpy(m, t, n * sizeof(zson_member));
+    }
+    ZSON_DEALLOC(&zson_global_allocator, t);
+}
+
+void zson_freeze(zson_value* v) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    assert(v != NULL);
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        /* parents first: trimming a container moves the children that are visited next */
+        if ((ZSON_TYPE_OF(v) == ZSON_ARRAY || ZSON_TYPE_OF(v) == ZSON_OBJECT) && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN)) {
+            zson_unshare(v);
+            if (ZSON_TYPE_OF(v) == ZSON_ARRAY)
+                zson_shrink_array(v);
+            else {
+                zson_shrink_object(v);
+                zson_sort_members(ZSON_MEMBERS_OF(v), v->u.o.size);
+            }
+            zson_walk_push(&s, v, NULL);
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            ZSON_SET_FLAGS((zson_value*)f->v, ZSON_FLAGS_OF(f->v) | ZSON_FROZEN);
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY)
+            v = &ZSON_ELEMENTS_OF(f->v)[f->i++];
+        else
+            v = &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+    }
+}
+
+int zson_is_frozen(const zson_value* v) {
+    assert(v != NULL);
+    return (ZSON_FLAGS_OF(v) & ZSON_FROZEN) != 0;
+}
+
+#define ZSON_ARENA_ROUND(n) (((n) + sizeof(zson_block) - 1) / sizeof(zson_block) * sizeof(zson_block))
+
+/*
+ * Next size bytes of the arena, behind a block header (the arena, then the reference count) unless
+ * they are key bytes owned by the members. Without an arena only *used grows.
+ */
+static void* zson_arena_copy(void* arena, size_t* used, const void* data, size_t size, int header) {
+    size_t at = *used;
+    zson_block* b;
+    *used += (header ? 2 * sizeof(zson_block) : 0) + ZSON_ARENA_ROUND(size);
+    if (arena == NULL)
+        return NULL;
+    b = (zson_block*)((char*)arena + at);
+    if (header) {
+        b[0].p = arena;
+        b[1].refs = 1;
+        b += 2;
+    }
+    memcpy(b, data, size);
+    return b;
+}
+
+/*
+ * Lays out the data of v and its descendants in depth-first order: each container, the keys of an
+ * object, then its children. Without an arena this only adds up the bytes and blocks it takes.
+ */
+static void zson_compact_tree(zson_value* v, void* arena, size_t* used, long* blocks) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    size_t i, n;
+    void* data;
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        switch (ZSON_TYPE_OF(v)) {
+            case ZSON_STRING:
+                data = zson_arena_copy(arena, used, ZSON_STRING_OF(v), v->u.s.len + 1, 1);
+                ++*blocks;
+                if (arena != NULL) {
+                    ZSON_SET_DATA(v, data);
+                    ZSON_SET_FLAGS(v, ZSON_FLAGS_OF(v) | ZSON_COMPACT);
+                }
+                break;
+            case ZSON_ARRAY:
+            case ZSON_OBJECT:
+                if (WALK_SIZE(v) == 0) {
+                    if (arena != NULL) {
+                        ZSON_SET_DATA(v, NULL);  /* the old block goes with the old tree */
+                        ZSON_SET_FLAGS(v, ZSON_FLAGS_OF(v) & ~ZSON_COMPACT);
+                        zson_set_capacity(v, 0);
+                    }
+                    break;
+                }
+                n = ZSON_TYPE_OF(v) == ZSON_OBJECT ? sizeof(zson_member) : ZSON_FLAGS_OF(v) & ZSON_PACKED_INT64 ? sizeof(zson_int64) :
+                    ZSON_FLAGS_OF(v) & ZSON_PACKED_DOUBLE ? sizeof(double) : sizeof(zson_value);
+                data = zson_arena_copy(arena, used, WALK_DATA(v), WALK_SIZE(v) * n, 1);
+                ++*blocks;
+                if (arena != NULL) {
+                    ZSON_SET_DATA(v, data);
+                    ZSON_SET_FLAGS(v, ZSON_FLAGS_OF(v) | ZSON_COMPACT);
+                    zson_set_capacity(v, v->u.a.size);
+                }
+                if (ZSON_TYPE_OF(v) == ZSON_OBJECT)
+                    for (i = 0; i < v->u.o.size; i++) {
+                        data = zson_arena_copy(arena, used, ZSON_MEMBERS_OF(v)[i].k, ZSON_MEMBERS_OF(v)[i].klen + 1, 0);
+                        if (arena != NULL)
+                            ZSON_MEMBERS_OF(v)[i].k = (char*)data;
+                    }
+                if (!(ZSON_FLAGS_OF(v) & ZSON_PACKED))
+                    zson_walk_push(&s, v, NULL);
+                break;
+            default: break;
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        v = ZSON_TYPE_OF(f->v) == ZSON_ARRAY ? &ZSON_ELEMENTS_OF(f->v)[f->i++] : &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+    }
+}
+
+void zson_compact(zson_value* v) {
+    const zson_allocator* a;
+    zson_value old;
+    size_t used = 0;
+    long blocks = 0;
+    void* arena;
+    assert(v != NULL);
+    zson_compact_tree(v, NULL, &used, &blocks);
+    if (blocks == 0)
+        return;
+    a = zson_value_allocator(v);  /* a value with blocks has one itself */
+    arena = zson_block_alloc(a, used);
+    ZSON_BLOCK(arena)->refs = blocks;
+    memcpy(&old, v, sizeof(zson_value));
+    used = 0;
+    blocks = 0;
+    zson_compact_tree(v, arena, &used, &blocks);  /* the copies hold no reference to the old blocks */
+    zson_release(&old);
+}
+
+struct zson_cell {
+    zson_value* volatile v;     /* published document */
+    volatile long epoch;        /* number of publishes */
+    volatile long readers[2];   /* readers that entered in an even or odd epoch */
+};
+
+zson_cell* zson_create_cell(void) {
+    zson_cell* c = (zson_cell*)ZSON_ALLOC(&zson_global_allocator, sizeof(zson_cell));
+    c->v = (zson_value*)ZSON_ALLOC(&zson_global_allocator, sizeof(zson_value));
+    zson_init(c->v);
+    c->epoch = 0;
+    c->readers[0] = c->readers[1] = 0;
+    return c;
+}
+
+void zson_free_cell(zson_cell* c) {
+    if (c == NULL)
+        return;
+    assert(c->readers[0] == 0 && c->readers[1] == 0);
+    zson_free(c->v);
+    ZSON_DEALLOC(&zson_global_allocator, c->v);
+    ZSON_DEALLOC(&zson_global_allocator, c);
+}
+
+/*
+ * The old document is freed once the readers of the epoch it was published in are gone. Readers of
+ * the epoch before were waited for by the previous publish, later readers already see the new one.
+ */
+/* Wait in a spin loop: pause the CPU for the first rounds, then give the rest of the time slice away. */
+static void zson_backoff(unsigned spins) {
+    if (spins < 64) {
+#ifdef ZSON_SSE2
+        _mm_pause();
+#endif
+    }
+    else {
+#if defined(_WIN32)
+        SwitchToThread();
+#elif defined(ZSON_SCHED_YIELD)
+        sched_yield();
+#endif
+    }
+}
+
+void zson_publish(zson_cell* c, zson_value* v) {
+    zson_value* old, *p;
+    unsigned spins;
+    long epoch;
+    assert(c != NULL && v != NULL);
+    p = (zson_value*)ZSON_ALLOC(&zson_global_allocator, sizeof(zson_value));
+    zson_init(p);
+    zson_move(p, v);
+    zson_freeze(p);
+    old = (zson_value*)ZSON_ATOMIC_CAS_PTR(&c->v, NULL, NULL);  /* never NULL, so only loads */
+    (void)ZSON_ATOMIC_CAS_PTR(&c->v, old, p);
+    epoch = ZSON_ATOMIC_INC(&c->epoch) - 1;
+    for (spins = 0; ZSON_ATOMIC_LOAD(&c->readers[epoch & 1]) != 0; spins++)
+        zson_backoff(spins);
+    zson_free(old);
+    ZSON_DEALLOC(&zson_global_allocator, old);
+}
+
+const zson_value* zson_acquire(zson_cell* c, unsigned* ticket) {
+    long epoch;
+    assert(c != NULL && ticket != NULL);
+    for (;;) {
+        epoch = ZSON_ATOMIC_LOAD(&c->epoch);
+        ZSON_ATOMIC_INC(&c->readers[epoch & 1]);
+        if (ZSON_ATOMIC_LOAD(&c->epoch) == epoch)
+            break;
+        ZSON_ATOMIC_DEC(&c->readers[epoch & 1]);  /* a publish got in between, its grace period may miss us */
+    }
+    *ticket = (unsigned)(epoch & 1);
+    return (const zson_value*)ZSON_ATOMIC_CAS_PTR(&c->v, NULL, NULL);
+}
+
+void zson_release_acquired(zson_cell* c, unsigned ticket) {
+    assert(c != NULL && ticket < 2);
+    ZSON_ATOMIC_DEC(&c->readers[ticket]);
+}
+
+struct zson_table {
+    size_t rows, columns;
+    zson_member* c;     /* one key per column, with the array of the column's values */
+    const zson_allocator* a;
+};
+
+/* Index of the member of row keyed like column j, rows usually list their keys in the same order. */
+static size_t zson_find_row_member(const zson_value* row, size_t j, const zson_member* column) {
+    const zson_member* m = &ZSON_MEMBERS_OF(row)[j];
+    if (m->klen == column->klen && memcmp(m->k, column->k, m->klen) == 0)
+        return j;
+    return zson_find_object_index(row, column->k, column->klen);
+}
+
+static zson_table* zson_build_table(const zson_value* v, const zson_allocator* a) {
+    const zson_value* first;
+    zson_table* t;
+    size_t i, j, k;
+    if (ZSON_TYPE_OF(v) != ZSON_ARRAY || (ZSON_FLAGS_OF(v) & ZSON_PACKED))
+        return NULL;
+    first = v->u.a.size > 0 ? &ZSON_ELEMENTS_OF(v)[0] : NULL;
+    if (first != NULL) {
+        if (ZSON_TYPE_OF(first) != ZSON_OBJECT)
+            return NULL;
+        for (j = 1; j < first->u.o.size; j++)
+            for (k = 0; k < j; k++)
+                if (ZSON_MEMBERS_OF(first)[k].klen == ZSON_MEMBERS_OF(first)[j].klen && memcmp(ZSON_MEMBERS_OF(first)[k].k, ZSON_MEMBERS_OF(first)[j].k, ZSON_MEMBERS_OF(first)[j].klen) == 0)
+                    return NULL;
+        for (i = 1; i < v->u.a.size; i++) {
+            const zson_value* row = &ZSON_ELEMENTS_OF(v)[i];
+            if (ZSON_TYPE_OF(row) != ZSON_OBJECT || row->u.o.size != first->u.o.size)
+                return NULL;
+            for (j = 0; j < first->u.o.size; j++)
+                if (zson_find_row_member(row, j, &ZSON_MEMBERS_OF(first)[j]) == ZSON_KEY_NOT_EXIST)
+                    return NULL;
+        }
+    }
+    t = (zson_table*)ZSON_ALLOC(a, sizeof(zson_table));
+    t->a = a;
+    t->rows = v->u.a.size;
+    t->columns = first != NULL ? first->u.o.size : 0;
+    t->c = t->columns > 0 ? (zson_member*)ZSON_ALLOC(a, t->columns * sizeof(zson_member)) : NULL;
+    for (j = 0; j < t->columns; j++) {
+        zson_member* m = &t->c[j];
+        memcpy(m->k = (char*)ZSON_ALLOC(a, ZSON_MEMBERS_OF(first)[j].klen + 1), ZSON_MEMBERS_OF(first)[j].k, ZSON_MEMBERS_OF(first)[j].klen + 1);
+        m->klen = ZSON_MEMBERS_OF(first)[j].klen;
+        zson_init(&m->v);
+        zson_alloc_array(&m->v, t->rows, a);
+        for (i = 0; i < t->rows; i++) {
+            const zson_value* row = &ZSON_ELEMENTS_OF(v)[i];
+            zson_init(&ZSON_ELEMENTS_OF(&m->v)[i]);
+            zson_copy(&ZSON_ELEMENTS_OF(&m->v)[i], &ZSON_MEMBERS_OF(row)[zson_find_row_member(row, j, m)].v);
+        }
+        m->v.u.a.size = t->rows;
+        zson_pack_array(&m->v);
+    }
+    return t;
+}
+
+zson_table* zson_create_table(const zson_value* v) {
+    assert(v != NULL);
+    return zson_build_table(v, zson_value_allocator(v));
+}
+
+int zson_parse_table(zson_table** t, const char* json) {
+    return zson_parse_table_ex(t, json, NULL);
+}
+
+int zson_parse_table_ex(zson_table** t, const char* json, const zson_parse_options* options) {
+    zson_value v;
+    int ret;
+    assert(t != NULL);
+    *t = NULL;
+    zson_init(&v);
+    if ((ret = zson_parse_ex(&v, json, options)) == ZSON_PARSE_OK)
+        *t = zson_build_table(&v, options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator);
+    zson_free(&v);
+    return ret;
+}
+
+void zson_free_table(zson_table* t) {
+    size_t j;
+    if (t == NULL)
+        return;
+    for (j = 0; j < t->columns; j++) {
+        ZSON_DEALLOC(t->a, t->c[j].k);
+        zson_free(&t->c[j].v);
+    }
+    if (t->c != NULL)
+        ZSON_DEALLOC(t->a, t->c);
+    ZSON_DEALLOC(t->a, t);
+}
+
+size_t zson_get_table_rows(const zson_table* t) {
+    assert(t != NULL);
+    return t->rows;
+}
+
+size_t zson_get_table_columns(const zson_table* t) {
+    assert(t != NULL);
+    return t->columns;
+}
+
+const char* zson_get_column_key(const zson_table* t, size_t column) {
+    assert(t != NULL && column < t->columns);
+    return t->c[column].k;
+}
+
+size_t zson_get_column_key_length(const zson_table* t, size_t column) {
+    assert(t != NULL && column < t->columns);
+    return t->c[column].klen;
+}
+
+size_t zson_find_column(const zson_table* t, const char* key, size_t klen) {
+    size_t j;
+    assert(t != NULL && key != NULL);
+    for (j = 0; j < t->columns; j++)
+        if (t->c[j].klen == klen && memcmp(t->c[j].k, key, klen) == 0)
+            return j;
+    return ZSON_KEY_NOT_EXIST;
+}
+
+const zson_value* zson_get_column(const zson_table* t, size_t column) {
+    assert(t != NULL && column < t->columns);
+    return &t->c[column].v;
+}
+
+void zson_table_to_value(zson_value* v, const zson_table* t) {
+    const zson_allocator* a;
+    zson_value scratch;
+    size_t i, j;
+    assert(v != NULL && t != NULL);
+    a = t->a;
+    zson_alloc_array(v, t->rows, a);
+    for (i = 0; i < t->rows; i++) {
+        zson_value* row = &ZSON_ELEMENTS_OF(v)[i];
+        zson_init(row);
+        zson_alloc_object(row, t->columns, a);
+        for (j = 0; j < t->columns; j++) {
+            zson_member* m = &ZSON_MEMBERS_OF(row)[j];
+            memcpy(m->k = (char*)ZSON_ALLOC(a, t->c[j].klen + 1), t->c[j].k, t->c[j].klen + 1);
+            m->klen = t->c[j].klen;
+            zson_init(&m->v);
+            zson_copy(&m->v, zson_array_element(&t->c[j].v, i, &scratch));
+        }
+        row->u.o.size = t->columns;
+    }
+    v->u.a.size = t->rows;
+}
+
+char* zson_stringify_table(const zson_table* t, size_t* length) {
+    zson_context c;
+    zson_value scratch;
+    size_t i, j;
+    assert(t != NULL);
+    zson_context_init(&c, NULL, 0);
+    c.stack = (char*)ZSON_ALLOC(c.a, c.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
+    PUTC(&c, '[');
+    for (i = 0; i < t->rows; i++) {
+        if (i > 0)
+            PUTC(&c, ',');
+        PUTC(&c, '{');
+        for (j = 0; j < t->columns; j++) {
+            if (j > 0)
+                PUTC(&c, ',');
+            zson_stringify_string(&c, t->c[j].k, t->c[j].klen);
+            PUTC(&c, ':');
+            zson_stringify_value(&c, zson_array_element(&t->c[j].v, i, &scratch));
+        }
+        PUTC(&c, '}');
+    }
+    PUTC(&c, ']');
+    if (length)
+        *length = c.top;
+    PUTC(&c, '\0');
+    return c.stack;
+}
+
+struct zson_tape {
+    zson_uint64* w;             /* words, right after this header */
+    char* s;                    /* string bytes, each followed by a NUL */
+    size_t size;                /* words */
+    const zson_allocator* a;    /* of the tape and the values built from it */
+};
+
+/*
+ * A word is a tag character in the top byte and a payload below it: '[' and '{' the word of their
+ * ']' or '}', which counts the elements or members; 's' and 'k' (keys) the offset of the bytes, with
+ * the length in the next word; 'd', 'l' and 'u' the bits of a double, zson_int64 or zson_uint64 next.
+ */
+#define TAPE_WORD(tag, n)   ((zson_uint64)(tag) << 56 | (zson_uint64)(n))
+#define TAPE_TAG(w)         ((int)((w) >> 56))
+#define TAPE_PAYLOAD(w)     ((size_t)((w) & (((zson_uint64)1 << 56) - 1)))
+
+typedef struct {
+    size_t start, size;         /* word of the opening bracket, elements or members so far */
+}zson_tape_frame;
+
+static void zson_tape_string(zson_context* c, zson_uint64* w, int tag, const char* s, size_t len) {
+    c->top += len;  /* the bytes were decoded in place */
+    PUTC(c, '\0');
+    w[0] = TAPE_WORD(tag, s - c->stack);
+    w[1] = len;
+}
+
+/*
+ * The tape takes at most one word per input byte plus one, the string bytes fewer than the input, so
+ * both are allocated once; the string stack of the context is the side buffer itself.
+ */
+int zson_parse_tape(zson_tape** tape, const char* json) {
+    return zson_parse_tape_ex(tape, json, NULL);
+}
+
+int zson_parse_tape_ex(zson_tape** tape, const char* json, const zson_parse_options* options) {
+    const zson_allocator* a = options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator;
+    zson_tape_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context c, s;
+    size_t len, n = 0;
+    zson_tape* t;
+    zson_value e;
+    char* str;
+    int ret;
+    assert(tape != NULL && json != NULL);
+    len = strlen(json);
+    t = (zson_tape*)ZSON_ALLOC(a, sizeof(zson_tape) + (len + 1) * sizeof(zson_uint64));
+    t->w = (zson_uint64*)(t + 1);
+    t->s = (char*)ZSON_ALLOC(a, len + 1);
+    t->a = a;
+    zson_context_init(&c, t->s, len + 1);
+    zson_context_init(&s, local, sizeof(local));
+    s.a = a;
+    if (options != NULL) {
+        if (options->max_depth != 0)
+            c.max_depth = options->max_depth;
+        c.flags = options->flags;
+    }
+    c.json = json;
+    zson_parse_whitespace(&c);
+    for (;;) {
+        /* the value at c.json */
+        if (*c.json == '[' || *c.json == '{') {
+            if (s.top / sizeof(zson_tape_frame) == c.max_depth) {
+                ret = ZSON_PARSE_NESTING_TOO_DEEP;
+                goto error;
+            }
+            f = (zson_tape_frame*)zson_context_push(&s, sizeof(zson_tape_frame));
+            f->start = n;
+            f->size = 0;
+            t->w[n++] = TAPE_WORD(*c.json++, 0);
+            zson_parse_whitespace(&c);
+            if (*c.json == (TAPE_TAG(t->w[f->start]) == '[' ? ']' : '}')) {
+                c.json++;
+                goto close;
+            }
+            goto element;
+        }
+        if (*c.json == '"') {
+            if ((ret = zson_parse_string_raw(&c, &str, &len)) != ZSON_PARSE_OK)
+                goto error;
+            zson_tape_string(&c, &t->w[n], 's', str, len);
+            n += 2;
+        }
+        else {
+            if ((ret = zson_parse_scalar(&c, &e)) != ZSON_PARSE_OK)
+                goto error;
+            switch (ZSON_TYPE_OF(&e)) {
+                case ZSON_NULL:  t->w[n++] = TAPE_WORD('n', 0); break;
+                case ZSON_FALSE: t->w[n++] = TAPE_WORD('f', 0); break;
+                case ZSON_TRUE:  t->w[n++] = TAPE_WORD('t', 0); break;
+                default:
+                    t->w[n++] = TAPE_WORD(ZSON_FLAGS_OF(&e) & ZSON_INT64 ? 'l' : ZSON_FLAGS_OF(&e) & ZSON_UINT64 ? 'u' : 'd', 0);
+                    if (ZSON_FLAGS_OF(&e) & ZSON_INTEGER)
+                        memcpy(&t->w[n++], &e.u, sizeof(zson_uint64));
+                    else
+                        memcpy(&t->w[n++], &ZSON_NUMBER_OF(&e), sizeof(double));
+            }
+        }
+    next:
+        /* ws [comma | closing bracket] ws of the enclosing container */
+        if (s.top == 0)
+            break;
+        f = (zson_tape_frame*)(s.stack + s.top) - 1;
+        zson_parse_whitespace(&c);
+        if (*c.json == ',') {
+            c.json++;
+            zson_parse_whitespace(&c);
+        }
+        else if (*c.json == (TAPE_TAG(t->w[f->start]) == '[' ? ']' : '}')) {
+            c.json++;
+            goto close;
+        }
+        else {
+            ret = TAPE_TAG(t->w[f->start]) == '[' ? ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET;
+            goto error;
         }
+    element:
+        f = (zson_tape_frame*)(s.stack + s.top) - 1;
+        f->size++;
+        if (TAPE_TAG(t->w[f->start]) == '{') {
+            if (*c.json != '"') {
+                ret = ZSON_PARSE_MISS_KEY;
+                goto error;
+            }
+            if ((ret = zson_parse_string_raw(&c, &str, &len)) != ZSON_PARSE_OK)
+                goto error;
+            zson_tape_string(&c, &t->w[n], 'k', str, len);
+            n += 2;
+            zson_parse_whitespace(&c);
+            if (*c.json != ':') {
+                ret = ZSON_PARSE_MISS_COLON;
+                goto error;
+            }
+            c.json++;
+            zson_parse_whitespace(&c);
+        }
+        continue;
+    close:
+        f = (zson_tape_frame*)zson_context_pop(&s, sizeof(zson_tape_frame));
+        t->w[f->start] |= n;
+        t->w[n++] = TAPE_WORD(TAPE_TAG(t->w[f->start]) + 2, f->size);  /* ']' and '}' follow '[' and '{' by 2 */
+        goto next;
+    }
+    zson_parse_whitespace(&c);
+    if (*c.json != '\0') {
+        ret = ZSON_PARSE_ROOT_NOT_SINGULAR;
+        goto error;
+    }
+    assert(c.stack == t->s && n <= strlen(json) + 1);
+    zson_context_release(&s);
+    t = (zson_tape*)ZSON_REALLOC(a, t, sizeof(zson_tape) + n * sizeof(zson_uint64));
+    t->w = (zson_uint64*)(t + 1);
+    t->size = n;
+    *tape = t;
+    return ZSON_PARSE_OK;
+error:
+    zson_context_release(&s);
+    ZSON_DEALLOC(a, t->s);
+    ZSON_DEALLOC(a, t);
+    *tape = NULL;
+    return ret;
+}
+
+void zson_free_tape(zson_tape* t) {
+    const zson_allocator* a;
+    if (t == NULL)
+        return;
+    a = t->a;
+    ZSON_DEALLOC(a, t->s);
+    ZSON_DEALLOC(a, t);
+}
+
+void zson_get_tape_root(const zson_tape* t, zson_cursor* c) {
+    assert(t != NULL && c != NULL);
+    c->t = t;
+    c->i = c->k = 0;
+}
+
+/* Word after the value at i. */
+static size_t zson_tape_skip(const zson_uint64* w, size_t i) {
+    switch (TAPE_TAG(w[i])) {
+        case '[': case '{': return TAPE_PAYLOAD(w[i]) + 1;
+        case 'd': case 'l': case 'u': case 's': return i + 2;
+        default: return i + 1;
+    }
+}
+
+/* The number at the cursor as a zson_value, so the getters convert it like zson_get_number() does. */
+static void zson_tape_number(const zson_cursor* c, zson_value* v) {
+    int tag = TAPE_TAG(c->t->w[c->i]);
+    const zson_uint64* w = &c->t->w[c->i + 1];
+    double d;
+    zson_int64 i;
+    assert(tag == 'd' || tag == 'l' || tag == 'u');
+    if (tag == 'd') {
+        memcpy(&d, w, sizeof(double));
+        ZSON_SET_DOUBLE(v, d);
+    }
+    else if (tag == 'l') {
+        memcpy(&i, w, sizeof(zson_int64));
+        ZSON_SET_INT64(v, i);
+    }
+    else
+        ZSON_SET_UINT64(v, *w);
+}
+
+zson_type zson_get_cursor_type(const zson_cursor* c) {
+    assert(c != NULL && c->t != NULL);
+    switch (TAPE_TAG(c->t->w[c->i])) {
+        case 'n': return ZSON_NULL;
+        case 'f': return ZSON_FALSE;
+        case 't': return ZSON_TRUE;
+        case 's': return ZSON_STRING;
+        case '[': return ZSON_ARRAY;
+        case '{': return ZSON_OBJECT;
+        default:  return ZSON_NUMBER;
+    }
+}
+
+double zson_get_cursor_number(const zson_cursor* c) {
+    zson_value v;
+    assert(c != NULL && c->t != NULL);
+    zson_tape_number(c, &v);
+    return zson_get_number(&v);
+}
+
+zson_int64 zson_get_cursor_int64(const zson_cursor* c) {
+    zson_value v;
+    assert(c != NULL && c->t != NULL);
+    zson_tape_number(c, &v);
+    return zson_get_int64(&v);
+}
+
+const char* zson_get_cursor_string(const zson_cursor* c, size_t* length) {
+    assert(c != NULL && c->t != NULL && TAPE_TAG(c->t->w[c->i]) == 's');
+    if (length != NULL)
+        *length = (size_t)c->t->w[c->i + 1];
+    return c->t->s + TAPE_PAYLOAD(c->t->w[c->i]);
+}
+
+size_t zson_get_cursor_size(const zson_cursor* c) {
+    assert(c != NULL && c->t != NULL && (TAPE_TAG(c->t->w[c->i]) == '[' || TAPE_TAG(c->t->w[c->i]) == '{'));
+    return TAPE_PAYLOAD(c->t->w[TAPE_PAYLOAD(c->t->w[c->i])]);
+}
+
+const char* zson_get_cursor_key(const zson_cursor* c, size_t* length) {
+    assert(c != NULL && c->t != NULL && c->k != 0);
+    if (length != NULL)
+        *length = (size_t)c->t->w[c->k + 1];
+    return c->t->s + TAPE_PAYLOAD(c->t->w[c->k]);
+}
+
+int zson_cursor_first(zson_cursor* c) {
+    const zson_uint64* w;
+    assert(c != NULL && c->t != NULL);
+    w = c->t->w;
+    assert(TAPE_TAG(w[c->i]) == '[' || TAPE_TAG(w[c->i]) == '{');
+    if (TAPE_PAYLOAD(w[c->i]) == c->i + 1)
+        return 0;
+    c->k = TAPE_TAG(w[c->i]) == '{' ? c->i + 1 : 0;
+    c->i += c->k != 0 ? 3 : 1;
+    return 1;
+}
+
+int zson_cursor_next(zson_cursor* c) {
+    size_t i;
+    assert(c != NULL && c->t != NULL);
+    i = zson_tape_skip(c->t->w, c->i);
+    switch (TAPE_TAG(c->t->w[i])) {
+        case ']': case '}': return 0;
+        case 'k':
+            c->k = i;
+            c->i = i + 2;
+            return 1;
+        default:
+            c->i = i;
+            return 1;
     }
-    assert(c.top == 0);
-    free(c.stack);
-    return ret;
 }
 
-static void zson_stringify_string(zson_context* c, const char* s, size_t len) {
-    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    size_t i, size;
-    char* head, *p;
-    assert(s != NULL);
-    p = head = zson_context_push(c, size = len * 6 + 2); /* "\u00xx..." */
-    *p++ = '"';
-    for (i = 0; i < len; i++) {
-        unsigned char ch = (unsigned char)s[i];
-        switch (ch) {
-            case '\"': *p++ = '\\'; *p++ = '\"'; break;
-            case '\\': *p++ = '\\'; *p++ = '\\'; break;
-            case '\b': *p++ = '\\'; *p++ = 'b';  break;
-            case '\f': *p++ = '\\'; *p++ = 'f';  break;
-            case '\n': *p++ = '\\'; *p++ = 'n';  break;
-            case '\r': *p++ = '\\'; *p++ = 'r';  break;
-            case '\t': *p++ = '\\'; *p++ = 't';  break;
-            default:
-                if (ch < 0x20) {
-                    *p++ = '\\'; *p++ = 'u'; *p++ = '0'; *p++ = '0';
-                    *p++ = hex_digits[ch >> 4];
-                    *p++ = hex_digits[ch & 15];
-                }
-                else
-                    *p++ = s[i];
+int zson_cursor_find(zson_cursor* c, const char* key, size_t klen) {
+    zson_cursor m;
+    assert(c != NULL && c->t != NULL && TAPE_TAG(c->t->w[c->i]) == '{' && key != NULL);
+    m = *c;
+    if (!zson_cursor_first(&m))
+        return 0;
+    do
+        if ((size_t)m.t->w[m.k + 1] == klen && memcmp(m.t->s + TAPE_PAYLOAD(m.t->w[m.k]), key, klen) == 0) {
+            *c = m;
+            return 1;
         }
-    }
-    *p++ = '"';
-    c->top -= size - (p - head);
+    while (zson_cursor_next(&m));
+    return 0;
 }
 
-static void zson_stringify_value(zson_context* c, const zson_value* v) {
+/* Containers are sized from their end word and filled in tape order, arrays packed like zson_parse() does. */
+void zson_cursor_to_value(zson_value* v, const zson_cursor* c) {
+    const zson_allocator* a;
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    const zson_uint64* w;
     size_t i;
-    switch (v->type) {
-        case ZSON_NULL:   PUTS(c, "null",  4); break;
-        case ZSON_FALSE:  PUTS(c, "false", 5); break;
-        case ZSON_TRUE:   PUTS(c, "true",  4); break;
-        case ZSON_NUMBER: c->top -= 32 - sprintf(zson_context_push(c, 32), "%.17g", v->u.n); break;
-        case ZSON_STRING: zson_stringify_string(c, v->u.s.s, v->u.s.len); break;
-        case ZSON_ARRAY:
-            PUTC(c, '[');
-            for (i = 0; i < v->u.a.size; i++) {
-                if (i > 0)
-                    PUTC(c, ',');
-                zson_stringify_value(c, &v->u.a.e[i]);
+    assert(v != NULL && c != NULL && c->t != NULL);
+    a = c->t->a;
+    w = c->t->w;
+    i = c->i;
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        switch (TAPE_TAG(w[i])) {
+            case '[':
+            case '{':
+                if (TAPE_TAG(w[i]) == '[')
+                    zson_alloc_array(v, TAPE_PAYLOAD(w[TAPE_PAYLOAD(w[i])]), a);
+                else
+                    zson_alloc_object(v, TAPE_PAYLOAD(w[TAPE_PAYLOAD(w[i])]), a);
+                zson_walk_push(&s, v, NULL);
+                i++;
+                break;
+            case 's':
+                zson_alloc_string(v, c->t->s + TAPE_PAYLOAD(w[i]), (size_t)w[i + 1], a);
+                i += 2;
+                break;
+            default: {
+                zson_cursor n;
+                n.t = c->t;
+                n.i = i;
+                switch (TAPE_TAG(w[i])) {
+                    case 'n': zson_release(v); break;
+                    case 'f': zson_release(v); ZSON_SET_TYPE(v, ZSON_FALSE); break;
+                    case 't': zson_release(v); ZSON_SET_TYPE(v, ZSON_TRUE); break;
+                    default:
+                        zson_release(v);
+                        zson_tape_number(&n, v);
+                }
+                i = zson_tape_skip(w, i);
             }
-            PUTC(c, ']');
-            break;
-        case ZSON_OBJECT:
-            PUTC(c, '{');
-            for (i = 0; i < v->u.o.size; i++) {
-                if (i > 0)
-                    PUTC(c, ',');
-                zson_stringify_string(c, v->u.o.m[i].k, v->u.o.m[i].klen);
-                PUTC(c, ':');
-                zson_stringify_value(c, &v->u.o.m[i].v);
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return;
             }
-            PUTC(c, '}');
-            break;
-        default: assert(0 && "invalid type");
+            f = WALK_TOP(&s);
+            if (f->i < ZSON_CAPACITY(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+            i++;  /* the closing word */
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY) {
+            v = &ZSON_ELEMENTS_OF(f->v)[f->i++];
+            ((zson_value*)f->v)->u.a.size++;
+        }
+        else {
+            zson_member* m = &ZSON_MEMBERS_OF(f->v)[f->i++];
+            ((zson_value*)f->v)->u.o.size++;
+            m->klen = (size_t)w[i + 1];
+            memcpy(m->k = (char*)ZSON_ALLOC(a, m->klen + 1), c->t->s + TAPE_PAYLOAD(w[i]), m->klen + 1);
+            v = &m->v;
+            i += 2;
+        }
+        zson_init(v);
     }
 }
 
-char* zson_stringify(const zson_value* v, size_t* length) {
-    zson_context c;
-    assert(v != NULL);
-    c.stack = (char*)malloc(c.size = ZSON_PARSE_STRINGIFY_INIT_SIZE);
-    c.top = 0;
-    zson_stringify_value(&c, v);
-    if (length)
-        *length = c.top;
-    PUTC(&c, '\0');
-    return c.stack;
+/* Chunk a file is read in, the buffer only grows for a single token that does not fit. */
+#ifndef ZSON_READER_CHUNK
+#define ZSON_READER_CHUNK (1 << 16)
+#endif
+
+/* What zson_reader_next() expects at c.json. */
+#define READER_VALUE    0   /* a value, or the closing bracket of an empty array */
+#define READER_KEY      1   /* a key, or the closing brace of an empty object */
+#define READER_COMMA    2   /* a comma or closing bracket, or the end after the root */
+#define READER_DONE     3
+
+struct zson_reader {
+    zson_context c;             /* c.json is the next byte; open brackets, then the last string */
+    FILE* fp;                   /* NULL when reading text in place */
+    char* buf;                  /* unread input from c.json on, followed by a NUL */
+    size_t size, capacity;
+    int state, first, eof, error;
+    zson_token token;
+    zson_value v;               /* number of the last NUMBER token */
+    char* s;                    /* bytes of the last KEY or STRING token */
+    size_t len;
+};
+
+#define ISTOKEN(ch)         (ISDIGIT(ch) || ((ch) >= 'a' && (ch) <= 'z') || (ch) == '+' || (ch) == '-' || (ch) == '.' || (ch) == 'E')
+
+static zson_reader* zson_reader_alloc(const zson_parse_options* options) {
+    const zson_allocator* a = options != NULL && options->allocator != NULL ? options->allocator : &zson_global_allocator;
+    zson_reader* r = (zson_reader*)ZSON_ALLOC(a, sizeof(zson_reader));
+    zson_context_init(&r->c, NULL, 0);
+    r->c.a = r->c.va = a;
+    if (options != NULL) {
+        if (options->max_depth != 0)
+            r->c.max_depth = options->max_depth;
+        r->c.flags = options->flags;
+    }
+    r->fp = NULL;
+    r->buf = NULL;
+    r->size = r->capacity = 0;
+    r->state = READER_VALUE;
+    r->first = r->eof = 0;
+    r->error = ZSON_PARSE_OK;
+    r->token = ZSON_TOKEN_END;
+    zson_init(&r->v);
+    r->s = NULL;
+    r->len = 0;
+    return r;
 }
 
-void zson_copy(zson_value* dst, const zson_value* src) {
-    assert(src != NULL && dst != NULL && src != dst);
-    size_t i;
-    switch (src->type) {
-        case ZSON_STRING:
-            zson_set_string(dst, src->u.s.s, src->u.s.len);
-            break;
-        case ZSON_ARRAY:
-            zson_set_array(dst, src->u.a.size);
-            for(i = 0; i < src->u.a.size; i++){
-                zson_copy(&dst->u.a.e[i], &src->u.a.e[i]);
-            }
-            dst->u.a.size = src->u.a.size;
-            break;
-        case ZSON_OBJECT:
-            zson_set_object(dst, src->u.o.size);
+zson_reader* zson_create_reader(const char* json) {
+    return zson_create_reader_ex(json, NULL);
+}
 
-            for(i = 0; i < src->u.o.size; i++){
-                zson_value * val = zson_set_object_value(dst, src->u.o.m[i].k, src->u.o.m[i].klen);
-                zson_copy(val, &src->u.o.m[i].v);
-            }
-            dst->u.o.size = src->u.o.size;
-            break;
-        default:
-            zson_free(dst);
-            memcpy(dst, src, sizeof(zson_value));
-            break;
+zson_reader* zson_create_reader_ex(const char* json, const zson_parse_options* options) {
+    zson_reader* r;
+    assert(json != NULL);
+    r = zson_reader_alloc(options);
+    r->c.json = json;
+    r->eof = 1;
+    return r;
+}
+
+zson_reader* zson_open_reader(const char* path) {
+    return zson_open_reader_ex(path, NULL);
+}
+
+zson_reader* zson_open_reader_ex(const char* path, const zson_parse_options* options) {
+    zson_reader* r;
+    FILE* fp;
+    assert(path != NULL);
+    if ((fp = fopen(path, "rb")) == NULL)
+        return NULL;
+    r = zson_reader_alloc(options);
+    r->fp = fp;
+    r->buf = (char*)ZSON_ALLOC(r->c.a, r->capacity = ZSON_READER_CHUNK);
+    r->buf[0] = '\0';
+    r->c.json = r->buf;
+    return r;
+}
+
+void zson_free_reader(zson_reader* r) {
+    if (r == NULL)
+        return;
+    if (r->fp != NULL) {
+        fclose(r->fp);
+        ZSON_DEALLOC(r->c.a, r->buf);
     }
+    zson_context_release(&r->c);
+    ZSON_DEALLOC(r->c.a, r);
 }
 
-void zson_move(zson_value* dst, zson_value* src) {
-    assert(dst != NULL && src != NULL && src != dst);
-    zson_free(dst);
-    memcpy(dst, src, sizeof(zson_value));
-    zson_init(src);
+/* Move the unread bytes to the front and read more after them, 0 at the end of the input. */
+static int zson_reader_fill(zson_reader* r) {
+    size_t keep, n;
+    if (r->eof)
+        return 0;
+    keep = r->size - (size_t)(r->c.json - r->buf);
+    memmove(r->buf, r->c.json, keep);
+    if (keep + 1 == r->capacity)
+        r->buf = (char*)ZSON_REALLOC(r->c.a, r->buf, r->capacity *= 2);
+    n = fread(r->buf + keep, 1, r->capacity - keep - 1, r->fp);
+    r->size = keep + n;
+    r->buf[r->size] = '\0';
+    r->c.json = r->buf;
+    if (n == 0) {
+        r->eof = 1;
+        if (ferror(r->fp))
+            r->error = ZSON_PARSE_IO_ERROR;
+    }
+    return n > 0;
 }
 
-void zson_swap(zson_value* lhs, zson_value* rhs) {
-    assert(lhs != NULL && rhs != NULL);
-    if (lhs != rhs) {
-        zson_value temp;
-        memcpy(&temp, lhs, sizeof(zson_value));
-        memcpy(lhs,   rhs, sizeof(zson_value));
-        memcpy(rhs, &temp, sizeof(zson_value));
+/* The NUL at c.json + i ends the buffered input rather than the text, and more could be read. */
+#define READER_MORE(r, i)   (!(r)->eof && (r)->c.json + (i) == (r)->buf + (r)->size)
+
+static void zson_reader_whitespace(zson_reader* r) {
+    do
+        zson_parse_whitespace(&r->c);
+    while (*r->c.json == '\0' && READER_MORE(r, 0) && zson_reader_fill(r));
+}
+
+/*
+ * Buffer the whole token at c.json so the lexers of zson_parse() see it end where the text does.
+ * Returns the offset of the closing quote of a string, or of whatever stopped the scan.
+ */
+static size_t zson_reader_token(zson_reader* r) {
+    size_t i = 0, end;
+    for (;;) {
+        const char* p = r->c.json;
+        if (*p == '"') {
+            for (i = i > 0 ? i : 1; p[i] != '"' && p[i] != '\0'; i++)
+                if (p[i] == '\\') {
+                    if (p[i + 1] == '\0')
+                        break;  /* rescanned once the escaped character is read */
+                    i++;
+                }
+            end = p[i] == '\\' ? i + 1 : i;
+        }
+        else {
+            while (ISTOKEN(p[i]))
+                i++;
+            end = i;
+        }
+        if (!READER_MORE(r, end) || !zson_reader_fill(r))
+            return i;
+    }
+}
+
+/* Decode the string at c.json above the open brackets, NUL-terminated like the strings of values. */
+static int zson_reader_string(zson_reader* r) {
+    size_t head = r->c.top;
+    int ret;
+    zson_reader_token(r);
+    if ((ret = zson_parse_string_raw(&r->c, &r->s, &r->len)) != ZSON_PARSE_OK)
+        return ret;
+    r->c.top += r->len;
+    PUTC(&r->c, '\0');
+    r->c.top = head;
+    r->s = r->c.stack + head;
+    return ZSON_PARSE_OK;
+}
+
+static zson_token zson_reader_fail(zson_reader* r, int error) {
+    if (r->error == ZSON_PARSE_OK)
+        r->error = error;  /* a read error explains whatever went wrong after it */
+    return r->token = ZSON_TOKEN_ERROR;
+}
+
+static zson_token zson_reader_close(zson_reader* r) {
+    char open = r->c.stack[--r->c.top];
+    r->c.json++;
+    r->state = READER_COMMA;
+    return r->token = open == '[' ? ZSON_TOKEN_END_ARRAY : ZSON_TOKEN_END_OBJECT;
+}
+
+zson_token zson_reader_next(zson_reader* r) {
+    int ret;
+    assert(r != NULL);
+    if (r->token == ZSON_TOKEN_ERROR)
+        return ZSON_TOKEN_ERROR;
+    for (;;) {
+        zson_reader_whitespace(r);
+        switch (r->state) {
+            case READER_DONE:
+                return r->token = ZSON_TOKEN_END;
+            case READER_COMMA:
+                if (r->c.top == 0) {
+                    if (*r->c.json != '\0')
+                        return zson_reader_fail(r, ZSON_PARSE_ROOT_NOT_SINGULAR);
+                    r->state = READER_DONE;
+                    return r->token = ZSON_TOKEN_END;
+                }
+                if (*r->c.json == ',') {
+                    r->c.json++;
+                    r->state = r->c.stack[r->c.top - 1] == '[' ? READER_VALUE : READER_KEY;
+                    r->first = 0;
+                    continue;
+                }
+                if (*r->c.json == (r->c.stack[r->c.top - 1] == '[' ? ']' : '}'))
+                    return zson_reader_close(r);
+                return zson_reader_fail(r, r->c.stack[r->c.top - 1] == '[' ?
+                    ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+            case READER_KEY:
+                if (r->first && *r->c.json == '}')
+                    return zson_reader_close(r);
+                if (*r->c.json != '"')
+                    return zson_reader_fail(r, ZSON_PARSE_MISS_KEY);
+                if ((ret = zson_reader_string(r)) != ZSON_PARSE_OK)
+                    return zson_reader_fail(r, ret);
+                zson_reader_whitespace(r);
+                if (*r->c.json != ':')
+                    return zson_reader_fail(r, ZSON_PARSE_MISS_COLON);
+                r->c.json++;
+                r->state = READER_VALUE;
+                r->first = 0;
+                return r->token = ZSON_TOKEN_KEY;
+            default:
+                break;
+        }
+        if (r->first && *r->c.json == ']')
+            return zson_reader_close(r);
+        r->first = 0;
+        r->state = READER_COMMA;
+        switch (*r->c.json) {
+            case '[':
+            case '{':
+                if (r->c.top == r->c.max_depth)
+                    return zson_reader_fail(r, ZSON_PARSE_NESTING_TOO_DEEP);
+                PUTC(&r->c, *r->c.json);
+                r->state = *r->c.json == '[' ? READER_VALUE : READER_KEY;
+                r->first = 1;
+                return r->token = *r->c.json++ == '[' ? ZSON_TOKEN_START_ARRAY : ZSON_TOKEN_START_OBJECT;
+            case '"':
+                if ((ret = zson_reader_string(r)) != ZSON_PARSE_OK)
+                    return zson_reader_fail(r, ret);
+                return r->token = ZSON_TOKEN_STRING;
+            default:
+                zson_reader_token(r);
+                if ((ret = zson_parse_scalar(&r->c, &r->v)) != ZSON_PARSE_OK)
+                    return zson_reader_fail(r, ret);
+                switch (ZSON_TYPE_OF(&r->v)) {
+                    case ZSON_NULL:  return r->token = ZSON_TOKEN_NULL;
+                    case ZSON_FALSE: return r->token = ZSON_TOKEN_FALSE;
+                    case ZSON_TRUE:  return r->token = ZSON_TOKEN_TRUE;
+                    default:         return r->token = ZSON_TOKEN_NUMBER;
+                }
+        }
+    }
+}
+
+/* Like zson_skip_value(), strings are stepped over without being decoded. */
+int zson_reader_skip(zson_reader* r) {
+    size_t depth, i;
+    char ch;
+    assert(r != NULL);
+    if (r->token == ZSON_TOKEN_KEY)
+        zson_reader_next(r);
+    if (r->token != ZSON_TOKEN_START_ARRAY && r->token != ZSON_TOKEN_START_OBJECT)
+        return r->token == ZSON_TOKEN_ERROR ? r->error : ZSON_PARSE_OK;
+    depth = r->c.top - 1;  /* once the container is closed */
+    for (;;) {
+        switch (ch = *r->c.json) {
+            case '"':
+                i = zson_reader_token(r);
+                if (r->c.json[i] != '"') {
+                    zson_reader_fail(r, ZSON_PARSE_MISS_QUOTATION_MARK);
+                    return r->error;
+                }
+                r->c.json += i + 1;
+                break;
+            case '[':
+            case '{':
+                if (r->c.top == r->c.max_depth) {
+                    zson_reader_fail(r, ZSON_PARSE_NESTING_TOO_DEEP);
+                    return r->error;
+                }
+                PUTC(&r->c, ch);
+                r->c.json++;
+                break;
+            case ']':
+            case '}':
+                if (r->c.stack[r->c.top - 1] != (ch == ']' ? '[' : '{')) {
+                    zson_reader_fail(r, ch == ']' ? ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET : ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET);
+                    return r->error;
+                }
+                zson_reader_close(r);
+                if (r->c.top == depth)
+                    return ZSON_PARSE_OK;
+                break;
+            case '\0':
+                if (!READER_MORE(r, 0) || !zson_reader_fill(r)) {
+                    zson_reader_fail(r, r->c.stack[r->c.top - 1] == '[' ?
+                        ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET : ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET);
+                    return r->error;
+                }
+                break;
+            default:
+                r->c.json++;
+        }
+    }
+}
+
+/* Room for one more element or member of a container being read, its first block comes from a. */
+static void zson_reader_grow(zson_value* v, const zson_allocator* a) {
+    size_t capacity = ZSON_CAPACITY(v);
+    if (WALK_SIZE(v) < capacity)
+        return;
+    capacity = capacity == 0 ? 1 : capacity << 1;
+    ZSON_SET_DATA(v, zson_block_realloc(a, WALK_DATA(v), capacity * (ZSON_TYPE_OF(v) == ZSON_ARRAY ? sizeof(zson_value) : sizeof(zson_member))));
+    zson_set_capacity(v, capacity);
+}
+
+/* Containers grow as their tokens arrive and are shrunk, arrays packed, once they are closed. */
+int zson_reader_read_value(zson_reader* r, zson_value* v) {
+    const zson_allocator* a;
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_value* root = v;
+    zson_context s;
+    zson_token t;
+    int ret;
+    assert(r != NULL && v != NULL);
+    a = r->c.va;
+    zson_free(v);
+    t = r->token == ZSON_TOKEN_KEY ? zson_reader_next(r) : r->token;
+    if (t == ZSON_TOKEN_END_ARRAY || t == ZSON_TOKEN_END_OBJECT)
+        return ZSON_PARSE_EXPECT_VALUE;  /* its container was closed, the stack below is not ours */
+    zson_context_init(&s, local, sizeof(local));
+    s.a = a;
+    for (;;) {
+        switch (t) {
+            case ZSON_TOKEN_NULL: break;
+            case ZSON_TOKEN_FALSE: ZSON_SET_TYPE(v, ZSON_FALSE); break;
+            case ZSON_TOKEN_TRUE: ZSON_SET_TYPE(v, ZSON_TRUE); break;
+            case ZSON_TOKEN_NUMBER: *v = r->v; break;
+            case ZSON_TOKEN_STRING: zson_alloc_string(v, r->s, r->len, a); break;
+            case ZSON_TOKEN_START_ARRAY: zson_alloc_array(v, 0, a); zson_walk_push(&s, v, NULL); break;
+            case ZSON_TOKEN_START_OBJECT: zson_alloc_object(v, 0, a); zson_walk_push(&s, v, NULL); break;
+            case ZSON_TOKEN_END_ARRAY:
+            case ZSON_TOKEN_END_OBJECT:
+                f = (zson_walk_frame*)zson_context_pop(&s, sizeof(zson_walk_frame));
+                v = (zson_value*)f->v;
+                if (t == ZSON_TOKEN_END_ARRAY)
+                    zson_shrink_array(v);
+                else
+                    zson_shrink_object(v);
+                break;
+            default:
+                ret = t == ZSON_TOKEN_ERROR ? r->error : ZSON_PARSE_EXPECT_VALUE;
+                zson_context_release(&s);
+                zson_free(root);
+                return ret;
+        }
+        if (s.top == 0) {
+            zson_context_release(&s);
+            return ZSON_PARSE_OK;
+        }
+        t = zson_reader_next(r);
+        if (t == ZSON_TOKEN_END_ARRAY || t == ZSON_TOKEN_END_OBJECT || t == ZSON_TOKEN_ERROR)
+            continue;
+        /* the open containers only grow once the values inside them are complete */
+        f = WALK_TOP(&s);
+        zson_reader_grow((zson_value*)f->v, a);
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY) {
+            v = &ZSON_ELEMENTS_OF(f->v)[((zson_value*)f->v)->u.a.size++];
+            zson_init(v);
+        }
+        else {
+            zson_value* o = (zson_value*)f->v;
+            zson_member* m;
+            m = &ZSON_MEMBERS_OF(o)[o->u.o.size++];
+            memcpy(m->k = (char*)ZSON_ALLOC(a, r->len + 1), r->s, r->len);
+            m->k[m->klen = r->len] = '\0';
+            v = &m->v;
+            zson_init(v);
+            t = zson_reader_next(r);
+        }
     }
 }
 
+int zson_get_reader_error(const zson_reader* r) {
+    assert(r != NULL);
+    return r->token == ZSON_TOKEN_ERROR ? r->error : ZSON_PARSE_OK;
+}
+
+const char* zson_get_reader_string(const zson_reader* r, size_t* length) {
+    assert(r != NULL && (r->token == ZSON_TOKEN_KEY || r->token == ZSON_TOKEN_STRING));
+    if (length != NULL)
+        *length = r->len;
+    return r->s;
+}
+
+double zson_get_reader_number(const zson_reader* r) {
+    assert(r != NULL && r->token == ZSON_TOKEN_NUMBER);
+    return zson_get_number(&r->v);
+}
+
+zson_int64 zson_get_reader_int64(const zson_reader* r) {
+    assert(r != NULL && r->token == ZSON_TOKEN_NUMBER);
+    return zson_get_int64(&r->v);
+}
+
 void zson_free(zson_value* v) {
-    size_t i;
     assert(v != NULL);
-    switch (v->type) {
-        case ZSON_STRING:
-            free(v->u.s.s);
-            break;
-        case ZSON_ARRAY:
-            for (i = 0; i < v->u.a.size; i++)
-                zson_free(&v->u.a.e[i]);
-            free(v->u.a.e);
-            break;
-        case ZSON_OBJECT:
-            for (i = 0; i < v->u.o.size; i++) {
-                free(v->u.o.m[i].k);
-                zson_free(&v->u.o.m[i].v);
-            }
-            free(v->u.o.m);
-            break;
-        default: break;
-    }
-    v->type = ZSON_NULL;
+    zson_release(v);
 }
 
 zson_type zson_get_type(const zson_value* v) {
     assert(v != NULL);
-    return v->type;
+    return ZSON_TYPE_OF(v);
+}
+
+static int zson_is_equal_number(const zson_value* lhs, const zson_value* rhs) {
+    if ((ZSON_FLAGS_OF(lhs) & ZSON_INTEGER) && (ZSON_FLAGS_OF(rhs) & ZSON_INTEGER))
+        return ZSON_FLAGS_OF(lhs) == ZSON_FLAGS_OF(rhs) && lhs->u.i == rhs->u.i;
+    return zson_get_number(lhs) == zson_get_number(rhs);
 }
 
 int zson_is_equal(const zson_value* lhs, const zson_value* rhs) {
-    size_t i, index;
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    zson_value lscratch, rscratch;
+    size_t index;
+    int equal = 1;
     assert(lhs != NULL && rhs != NULL);
-    if (lhs->type != rhs->type)
-        return 0;
-    switch (lhs->type) {
-        case ZSON_STRING:
-            return lhs->u.s.len == rhs->u.s.len && 
-                memcmp(lhs->u.s.s, rhs->u.s.s, lhs->u.s.len) == 0;
-        case ZSON_NUMBER:
-            return lhs->u.n == rhs->u.n;
-        case ZSON_ARRAY:
-            if (lhs->u.a.size != rhs->u.a.size)
-                return 0;
-            for (i = 0; i < lhs->u.a.size; i++)
-                if (!zson_is_equal(&lhs->u.a.e[i], &rhs->u.a.e[i]))
-                    return 0;
-            return 1;
-        case ZSON_OBJECT:
-            if (lhs->u.o.size != rhs->u.o.size)
-                return 0;
-            for (i = 0; i < lhs->u.o.size; i++) {
-                index = zson_find_object_index(rhs, lhs->u.o.m[i].k, lhs->u.o.m[i].klen);
-                if (index == ZSON_KEY_NOT_EXIST) return 0;
-                if (!zson_is_equal(&lhs->u.o.m[i].v, &rhs->u.o.m[index].v)) return 0;
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        if (ZSON_TYPE_OF(lhs) != ZSON_TYPE_OF(rhs))
+            break;
+        switch (ZSON_TYPE_OF(lhs)) {
+            case ZSON_STRING:
+                equal = lhs->u.s.len == rhs->u.s.len &&
+                    memcmp(ZSON_STRING_OF(lhs), ZSON_STRING_OF(rhs), lhs->u.s.len) == 0;
+                break;
+            case ZSON_NUMBER:
+                equal = zson_is_equal_number(lhs, rhs);
+                break;
+            case ZSON_ARRAY:
+            case ZSON_OBJECT:
+                if ((equal = WALK_SIZE(lhs) == WALK_SIZE(rhs)))
+                    zson_walk_push(&s, lhs, rhs);
+                break;
+            default: break;
+        }
+        if (!equal)
+            break;
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                return 1;
             }
-            return 1;
-        default:
-            return 1;
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        if (ZSON_TYPE_OF(f->v) == ZSON_ARRAY) {
+            lhs = zson_array_element(f->v, f->i, &lscratch);
+            rhs = zson_array_element(f->w, f->i++, &rscratch);
+        }
+        else {
+            index = zson_find_object_index(f->w, ZSON_MEMBERS_OF(f->v)[f->i].k, ZSON_MEMBERS_OF(f->v)[f->i].klen);
+            if (index == ZSON_KEY_NOT_EXIST)
+                break;
+            lhs = &ZSON_MEMBERS_OF(f->v)[f->i++].v;
+            rhs = &ZSON_MEMBERS_OF(f->w)[index].v;
+        }
+    }
+    zson_context_release(&s);
+    return 0;
+}
+
+size_t zson_memory_usage(const zson_value* v, zson_memory* usage) {
+    zson_walk_frame local[ZSON_WALK_LOCAL_DEPTH], *f;
+    zson_context s;
+    zson_memory m;
+    size_t i, n;
+    assert(v != NULL);
+    m.nodes = m.keys = m.strings = m.unused = 0;
+    zson_context_init(&s, local, sizeof(local));
+    for (;;) {
+        switch (ZSON_TYPE_OF(v)) {
+            case ZSON_STRING:
+                m.strings += v->u.s.len + 1;
+                break;
+            case ZSON_ARRAY:
+                n = ZSON_FLAGS_OF(v) & ZSON_PACKED_INT64 ? sizeof(zson_int64) : ZSON_FLAGS_OF(v) & ZSON_PACKED_DOUBLE ? sizeof(double) : sizeof(zson_value);
+                m.nodes += v->u.a.size * n;
+                m.unused += (ZSON_CAPACITY(v) - v->u.a.size) * n;
+                if (!(ZSON_FLAGS_OF(v) & ZSON_PACKED))
+                    zson_walk_push(&s, v, NULL);
+                break;
+            case ZSON_OBJECT:
+                m.nodes += v->u.o.size * sizeof(zson_member);
+                m.unused += (ZSON_CAPACITY(v) - v->u.o.size) * sizeof(zson_member);
+                for (i = 0; i < v->u.o.size; i++)
+                    m.keys += ZSON_MEMBERS_OF(v)[i].klen + 1;
+                zson_walk_push(&s, v, NULL);
+                break;
+            default: break;
+        }
+        for (;;) {
+            if (s.top == 0) {
+                zson_context_release(&s);
+                if (usage != NULL)
+                    *usage = m;
+                return m.nodes + m.keys + m.strings + m.unused;
+            }
+            f = WALK_TOP(&s);
+            if (f->i < WALK_SIZE(f->v))
+                break;
+            zson_context_pop(&s, sizeof(zson_walk_frame));
+        }
+        v = ZSON_TYPE_OF(f->v) == ZSON_ARRAY ? &ZSON_ELEMENTS_OF(f->v)[f->i++] : &ZSON_MEMBERS_OF(f->v)[f->i++].v;
     }
 }
 
+void zson_get_stats(zson_stats* stats) {
+    assert(stats != NULL);
+#ifdef ZSON_STATS
+    *stats = zson_thread_stats;
+#else
+    memset(stats, 0, sizeof(zson_stats));
+#endif
+}
+
+void zson_reset_stats(void) {
+#ifdef ZSON_STATS
+    memset(&zson_thread_stats, 0, sizeof(zson_stats));
+#endif
+}
+
+#ifdef ZSON_TRACE
+static zson_trace_hooks zson_global_trace_hooks = { NULL, NULL, NULL };
+
+static double zson_trace_now(void) {
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void zson_trace_begin(zson_trace_kind kind, zson_trace_mark* mark) {
+    if (zson_global_trace_hooks.begin != NULL)
+        zson_global_trace_hooks.begin(zson_global_trace_hooks.ctx, kind);
+    *mark = zson_trace_now();
+}
+
+static void zson_trace_end(zson_trace_kind kind, zson_trace_mark mark, size_t bytes) {
+    zson_thread_trace.seconds[kind] += zson_trace_now() - mark;
+    zson_thread_trace.count[kind]++;
+    zson_thread_trace.bytes[kind] += bytes;
+    if (zson_global_trace_hooks.end != NULL)
+        zson_global_trace_hooks.end(zson_global_trace_hooks.ctx, kind, bytes);
+}
+#endif
+
+void zson_get_trace(zson_trace* trace) {
+    assert(trace != NULL);
+#ifdef ZSON_TRACE
+    *trace = zson_thread_trace;
+#else
+    memset(trace, 0, sizeof(zson_trace));
+#endif
+}
+
+void zson_reset_trace(void) {
+#ifdef ZSON_TRACE
+    memset(&zson_thread_trace, 0, sizeof(zson_trace));
+#endif
+}
+
+void zson_set_trace_hooks(const zson_trace_hooks* hooks) {
+#ifdef ZSON_TRACE
+    static const zson_trace_hooks none = { NULL, NULL, NULL };
+    zson_global_trace_hooks = hooks != NULL ? *hooks : none;
+#else
+    (void)hooks;
+#endif
+}
+
 int zson_get_boolean(const zson_value* v) {
-    assert(v != NULL && (v->type == ZSON_TRUE || v->type == ZSON_FALSE));
-    return v->type == ZSON_TRUE;
+    assert(v != NULL && (ZSON_TYPE_OF(v) == ZSON_TRUE || ZSON_TYPE_OF(v) == ZSON_FALSE));
+    return ZSON_TYPE_OF(v) == ZSON_TRUE;
 }
 
 void zson_set_boolean(zson_value* v, int b) {
     zson_free(v);
-    v->type = b ? ZSON_TRUE : ZSON_FALSE;
+    ZSON_SET_TYPE(v, b ? ZSON_TRUE : ZSON_FALSE);
 }
 
 double zson_get_number(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_NUMBER);
-    return v->u.n;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_NUMBER);
+    if (ZSON_FLAGS_OF(v) & ZSON_INT64)
+        return (double)v->u.i;
+    if (ZSON_FLAGS_OF(v) & ZSON_UINT64)
+        return (double)v->u.ui;
+    return ZSON_NUMBER_OF(v);
 }
 
 void zson_set_number(zson_value* v, double n) {
     zson_free(v);
-    v->u.n = n;
-    v->type = ZSON_NUMBER;
+    ZSON_SET_DOUBLE(v, n);
+}
+
+int zson_is_integer(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_NUMBER);
+    return (ZSON_FLAGS_OF(v) & ZSON_INTEGER) != 0;
+}
+
+zson_int64 zson_get_int64(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_NUMBER);
+    if (ZSON_FLAGS_OF(v) & ZSON_INT64)
+        return v->u.i;
+    if (ZSON_FLAGS_OF(v) & ZSON_UINT64)
+        return ZSON_INT64_MAX;
+    /* saturate, casting an out-of-range double is undefined */
+    if (ZSON_NUMBER_OF(v) != ZSON_NUMBER_OF(v))
+        return 0;
+    if (ZSON_NUMBER_OF(v) >= 9223372036854775808.0)
+        return ZSON_INT64_MAX;
+    if (ZSON_NUMBER_OF(v) < -9223372036854775808.0)
+        return ZSON_INT64_MIN;
+    return (zson_int64)ZSON_NUMBER_OF(v);
+}
+
+void zson_set_int64(zson_value* v, zson_int64 i) {
+    zson_free(v);
+    ZSON_SET_INT64(v, i);
+}
+
+zson_uint64 zson_get_uint64(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_NUMBER);
+    if (ZSON_FLAGS_OF(v) & ZSON_INT64)
+        return v->u.i < 0 ? 0 : (zson_uint64)v->u.i;
+    if (ZSON_FLAGS_OF(v) & ZSON_UINT64)
+        return v->u.ui;
+    if (ZSON_NUMBER_OF(v) >= 18446744073709551616.0)
+        return ZSON_UINT64_MAX;
+    if (ZSON_NUMBER_OF(v) <= 0.0 || ZSON_NUMBER_OF(v) != ZSON_NUMBER_OF(v))
+        return 0;
+    return (zson_uint64)ZSON_NUMBER_OF(v);
+}
+
+void zson_set_uint64(zson_value* v, zson_uint64 u) {
+    zson_free(v);
+    if (u > (zson_uint64)ZSON_INT64_MAX)
+        ZSON_SET_UINT64(v, u);
+    else
+        ZSON_SET_INT64(v, (zson_int64)u);
 }
 
 const char* zson_get_string(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_STRING);
-    return v->u.s.s;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_STRING);
+    return ZSON_STRING_OF(v);
 }
 
 size_t zson_get_string_length(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_STRING);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_STRING);
     return v->u.s.len;
 }
 
 void zson_set_string(zson_value* v, const char* s, size_t len) {
     assert(v != NULL && (s != NULL || len == 0));
-    zson_free(v);
-    v->u.s.s = (char*)malloc(len + 1);
-    memcpy(v->u.s.s, s, len);
-    v->u.s.s[len] = '\0';
-    v->u.s.len = len;
-    v->type = ZSON_STRING;
+    zson_alloc_string(v, s, len, &zson_global_allocator);
 }
 
 void zson_set_array(zson_value* v, size_t capacity) {
     assert(v != NULL);
-    zson_free(v);
-    v->type = ZSON_ARRAY;
-    v->u.a.size = 0;
-    v->u.a.capacity = capacity;
-    v->u.a.e = capacity > 0 ? (zson_value*)malloc(capacity * sizeof(zson_value)) : NULL;
+    zson_alloc_array(v, capacity, &zson_global_allocator);
 }
 
 size_t zson_get_array_size(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY);
     return v->u.a.size;
 }
 
 size_t zson_get_array_capacity(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
-    return v->u.a.capacity;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY);
+    return ZSON_CAPACITY(v);
 }
 
 void zson_reserve_array(zson_value* v, size_t capacity) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
-    if (v->u.a.capacity < capacity) {
-        v->u.a.capacity = capacity;
-        v->u.a.e = (zson_value*)realloc(v->u.a.e, capacity * sizeof(zson_value));
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    if (ZSON_CAPACITY(v) < capacity) {
+        zson_unshare(v);
+        ZSON_SET_DATA(v, zson_block_realloc(&zson_global_allocator, ZSON_ELEMENTS_OF(v), capacity * sizeof(zson_value)));
+        zson_set_capacity(v, capacity);
     }
 }
 
 void zson_shrink_array(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
-    if (v->u.a.capacity > v->u.a.size) {
-        v->u.a.capacity = v->u.a.size;
-        v->u.a.e = (zson_value*)realloc(v->u.a.e, v->u.a.capacity * sizeof(zson_value));
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    if (ZSON_CAPACITY(v) > v->u.a.size) {
+        zson_unshare(v);
+        ZSON_SET_DATA(v, zson_block_realloc(&zson_global_allocator, ZSON_ELEMENTS_OF(v), v->u.a.size * sizeof(zson_value)));
+        zson_set_capacity(v, v->u.a.size);
     }
 }
 
 void zson_clear_array(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
     zson_erase_array_element(v, 0, v->u.a.size);
 }
 
 zson_value* zson_get_array_element(zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY);
+    assert(index < v->u.a.size);
+    zson_unshare_elements(v);
+    return &ZSON_ELEMENTS_OF(v)[index];
+}
+
+const zson_value* zson_get_array_element_const(const zson_value* v, size_t index, zson_value* scratch) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && scratch != NULL);
     assert(index < v->u.a.size);
-    return &v->u.a.e[index];
+    return zson_array_element(v, index, scratch);
 }
 
 zson_value* zson_pushback_array_element(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY);
-    if (v->u.a.size == v->u.a.capacity)
-        zson_reserve_array(v, v->u.a.capacity == 0 ? 1 : v->u.a.capacity * 2);
-    zson_init(&v->u.a.e[v->u.a.size]);
-    return &v->u.a.e[v->u.a.size++];
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
+    if (v->u.a.size == ZSON_CAPACITY(v))
+        zson_reserve_array(v, v->u.a.size == 0 ? 1 : v->u.a.size * 2);
+    zson_init(&ZSON_ELEMENTS_OF(v)[v->u.a.size]);
+    return &ZSON_ELEMENTS_OF(v)[v->u.a.size++];
 }
 
 void zson_popback_array_element(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_ARRAY && v->u.a.size > 0);
-    zson_free(&v->u.a.e[--v->u.a.size]);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && v->u.a.size > 0 && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
+    zson_free(&ZSON_ELEMENTS_OF(v)[--v->u.a.size]);
 }
 
 zson_value* zson_insert_array_element(zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_ARRAY && index <= v->u.a.size);
-    if (v->u.a.size == v->u.a.capacity) zson_reserve_array(v, v->u.a.capacity == 0 ? 1: (v->u.a.size << 1));
-    memcpy(&v->u.a.e[index + 1], &v->u.a.e[index], (v->u.a.size - index) * sizeof(zson_value));
-    zson_init(&v->u.a.e[index]);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && index <= v->u.a.size && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
+    if (v->u.a.size == ZSON_CAPACITY(v)) zson_reserve_array(v, v->u.a.size == 0 ? 1: (v->u.a.size << 1));
+    memmove(&ZSON_ELEMENTS_OF(v)[index + 1], &ZSON_ELEMENTS_OF(v)[index], (v->u.a.size - index) * sizeof(zson_value));
+    zson_init(&ZSON_ELEMENTS_OF(v)[index]);
     v->u.a.size++;
-    return &v->u.a.e[index];
+    return &ZSON_ELEMENTS_OF(v)[index];
 }
 
 void zson_erase_array_element(zson_value* v, size_t index, size_t count) {
-    assert(v != NULL && v->type == ZSON_ARRAY && index + count <= v->u.a.size);
     size_t i;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && index + count <= v->u.a.size && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
     for(i = index; i < index + count; i++){
-        zson_free(&v->u.a.e[i]);
+        zson_free(&ZSON_ELEMENTS_OF(v)[i]);
     }
-    memcpy(v->u.a.e + index, v->u.a.e + index + count, (v->u.a.size - index - count) * sizeof(zson_value));
+    memmove(ZSON_ELEMENTS_OF(v) + index, ZSON_ELEMENTS_OF(v) + index + count, (v->u.a.size - index - count) * sizeof(zson_value));
     for(i = v->u.a.size - count; i < v->u.a.size; i++)
-        zson_init(&v->u.a.e[i]);
+        zson_init(&ZSON_ELEMENTS_OF(v)[i]);
     v->u.a.size -= count;
 }
 
+int zson_get_number_array(const zson_value* v, const double** numbers, size_t* size) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && numbers != NULL && size != NULL);
+    if (!(ZSON_FLAGS_OF(v) & ZSON_PACKED_DOUBLE))
+        return 0;
+    *numbers = PACKED_DOUBLES(v);
+    *size = v->u.a.size;
+    return 1;
+}
+
+int zson_get_int64_array(const zson_value* v, const zson_int64** numbers, size_t* size) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY && numbers != NULL && size != NULL);
+    if (!(ZSON_FLAGS_OF(v) & ZSON_PACKED_INT64))
+        return 0;
+    *numbers = PACKED_INT64S(v);
+    *size = v->u.a.size;
+    return 1;
+}
+
+int zson_pack_array(zson_value* v) {
+    zson_value packed;
+    unsigned flags;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY);
+    if (ZSON_FLAGS_OF(v) & (ZSON_PACKED | ZSON_FROZEN))
+        return (ZSON_FLAGS_OF(v) & ZSON_PACKED) != 0;
+    if ((flags = zson_packable(ZSON_ELEMENTS_OF(v), v->u.a.size)) == 0)
+        return 0;
+    zson_init(&packed);
+    zson_alloc_packed(&packed, ZSON_ELEMENTS_OF(v), v->u.a.size, flags, zson_value_allocator(v));
+    zson_move(v, &packed);
+    return 1;
+}
+
 void zson_set_object(zson_value* v, size_t capacity) {
     assert(v != NULL);
-    zson_free(v);
-    v->type = ZSON_OBJECT;
-    v->u.o.size = 0;
-    v->u.o.capacity = capacity;
-    v->u.o.m = capacity > 0 ? (zson_member*)malloc(capacity * sizeof(zson_member)) : NULL;
+    zson_alloc_object(v, capacity, &zson_global_allocator);
 }
 
 size_t zson_get_object_size(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
     return v->u.o.size;
 }
 
 size_t zson_get_object_capacity(const zson_value* v) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
-    return v->u.o.capacity;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
+    return ZSON_CAPACITY(v);
     return 0;
 }
 
 void zson_reserve_object(zson_value* v, size_t capacity) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
-    if(v->u.o.capacity < capacity){
-        v->u.o.capacity = capacity;
-        v->u.o.m = (zson_member *) realloc(v->u.o.m, capacity * sizeof(zson_member));
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    if(ZSON_CAPACITY(v) < capacity){
+        zson_unshare(v);
+        ZSON_SET_DATA(v, zson_block_realloc(&zson_global_allocator, ZSON_MEMBERS_OF(v), capacity * sizeof(zson_member)));
+        zson_set_capacity(v, capacity);
     }
 }
 
 void zson_shrink_object(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
-    if(v->u.o.capacity > v->u.o.size) {
-        v->u.o.capacity = v->u.o.size;
-        v->u.o.m = (zson_member *)realloc(v->u.o.m, v->u.o.capacity * sizeof(zson_value));
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    if(ZSON_CAPACITY(v) > v->u.o.size) {
+        zson_unshare(v);
+        ZSON_SET_DATA(v, zson_block_realloc(&zson_global_allocator, ZSON_MEMBERS_OF(v), v->u.o.size * sizeof(zson_member)));
+        zson_set_capacity(v, v->u.o.size);
     }
 }
 
 void zson_clear_object(zson_value* v) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
     size_t i;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
     for(i = 0; i < v->u.o.size; i++){
-        free(v->u.o.m[i].k);
-        v->u.o.m[i].k = NULL;
-        v->u.o.m[i].klen = 0;
-        zson_free(&v->u.o.m[i].v);
+        ZSON_DEALLOC(ZSON_OWNER(ZSON_MEMBERS_OF(v)), ZSON_MEMBERS_OF(v)[i].k);
+        ZSON_MEMBERS_OF(v)[i].k = NULL;
+        ZSON_MEMBERS_OF(v)[i].klen = 0;
+        zson_free(&ZSON_MEMBERS_OF(v)[i].v);
     }
     v->u.o.size = 0;
 }
 
 const char* zson_get_object_key(const zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
     assert(index < v->u.o.size);
-    return v->u.o.m[index].k;
+    return ZSON_MEMBERS_OF(v)[index].k;
 }
 
 size_t zson_get_object_key_length(const zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
     assert(index < v->u.o.size);
-    return v->u.o.m[index].klen;
+    return ZSON_MEMBERS_OF(v)[index].klen;
 }
 
 zson_value* zson_get_object_value(zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_OBJECT);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
     assert(index < v->u.o.size);
-    return &v->u.o.m[index].v;
+    zson_unshare_elements(v);
+    return &ZSON_MEMBERS_OF(v)[index].v;
+}
+
+const zson_value* zson_get_object_value_const(const zson_value* v, size_t index) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
+    assert(index < v->u.o.size);
+    return &ZSON_MEMBERS_OF(v)[index].v;
 }
 
 size_t zson_find_object_index(const zson_value* v, const char* key, size_t klen) {
     size_t i;
-    assert(v != NULL && v->type == ZSON_OBJECT && key != NULL);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && key != NULL);
+    if (ZSON_FLAGS_OF(v) & ZSON_FROZEN) {
+        size_t lo = 0, hi = v->u.o.size;
+        while (lo < hi) {
+            size_t mid = lo + ((hi - lo) >> 1);
+            if (zson_compare_key(ZSON_MEMBERS_OF(v)[mid].k, ZSON_MEMBERS_OF(v)[mid].klen, key, klen) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo < v->u.o.size && zson_compare_key(ZSON_MEMBERS_OF(v)[lo].k, ZSON_MEMBERS_OF(v)[lo].klen, key, klen) == 0 ? lo : ZSON_KEY_NOT_EXIST;
+    }
     for (i = 0; i < v->u.o.size; i++)
-        if (v->u.o.m[i].klen == klen && memcmp(v->u.o.m[i].k, key, klen) == 0)
+        if (ZSON_MEMBERS_OF(v)[i].klen == klen && memcmp(ZSON_MEMBERS_OF(v)[i].k, key, klen) == 0)
             return i;
     return ZSON_KEY_NOT_EXIST;
 }
 
 zson_value* zson_find_object_value(zson_value* v, const char* key, size_t klen) {
     size_t index = zson_find_object_index(v, key, klen);
-    return index != ZSON_KEY_NOT_EXIST ? &v->u.o.m[index].v : NULL;
+    if (index == ZSON_KEY_NOT_EXIST)
+        return NULL;
+    zson_unshare_elements(v);
+    return &ZSON_MEMBERS_OF(v)[index].v;
+}
+
+const zson_value* zson_find_object_value_const(const zson_value* v, const char* key, size_t klen) {
+    size_t index = zson_find_object_index(v, key, klen);
+    return index == ZSON_KEY_NOT_EXIST ? NULL : &ZSON_MEMBERS_OF(v)[index].v;
 }
 
 zson_value* zson_set_object_value(zson_value* v, const char* key, size_t klen) {
-    assert(v != NULL && v->type == ZSON_OBJECT && key != NULL);
     size_t i, index;
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && key != NULL && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
     index = zson_find_object_index(v, key, klen);
     if(index != ZSON_KEY_NOT_EXIST)
-        return &v->u.o.m[index].v;
-    if(v->u.o.size == v->u.o.capacity){
-        zson_reserve_object(v, v->u.o.capacity == 0? 1: (v->u.o.capacity << 1));
+        return &ZSON_MEMBERS_OF(v)[index].v;
+    if(v->u.o.size == ZSON_CAPACITY(v)){
+        zson_reserve_object(v, v->u.o.size == 0? 1: (v->u.o.size << 1));
     }
     i = v->u.o.size;
-    v->u.o.m[i].k = (char *)malloc((klen + 1));
-    memcpy(v->u.o.m[i].k, key, klen);
-    v->u.o.m[i].k[klen] = '\0';
-    v->u.o.m[i].klen = klen;
-    zson_init(&v->u.o.m[i].v);
+    ZSON_MEMBERS_OF(v)[i].k = (char *)ZSON_ALLOC(ZSON_OWNER(ZSON_MEMBERS_OF(v)), klen + 1);
+    memcpy(ZSON_MEMBERS_OF(v)[i].k, key, klen);
+    ZSON_MEMBERS_OF(v)[i].k[klen] = '\0';
+    ZSON_MEMBERS_OF(v)[i].klen = klen;
+    zson_init(&ZSON_MEMBERS_OF(v)[i].v);
     v->u.o.size++;
-    return &v->u.o.m[i].v;
+    return &ZSON_MEMBERS_OF(v)[i].v;
 }
 
 void zson_remove_object_value(zson_value* v, size_t index) {
-    assert(v != NULL && v->type == ZSON_OBJECT && index < v->u.o.size);
-    free(v->u.o.m[index].k);
-    zson_free(&v->u.o.m[index].v);
-    memcpy(v->u.o.m + index, v->u.o.m + index + 1, (v->u.o.size - index - 1) * sizeof(zson_member));
-    v->u.o.m[--v->u.o.size].k = NULL;
-    v->u.o.m[v->u.o.size].klen = 0;
-    zson_init(&v->u.o.m[v->u.o.size].v);
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT && index < v->u.o.size && !(ZSON_FLAGS_OF(v) & ZSON_FROZEN));
+    zson_unshare(v);
+    ZSON_DEALLOC(ZSON_OWNER(ZSON_MEMBERS_OF(v)), ZSON_MEMBERS_OF(v)[index].k);
+    zson_free(&ZSON_MEMBERS_OF(v)[index].v);
+    memmove(ZSON_MEMBERS_OF(v) + index, ZSON_MEMBERS_OF(v) + index + 1, (v->u.o.size - index - 1) * sizeof(zson_member));
+    ZSON_MEMBERS_OF(v)[--v->u.o.size].k = NULL;
+    ZSON_MEMBERS_OF(v)[v->u.o.size].klen = 0;
+    zson_init(&ZSON_MEMBERS_OF(v)[v->u.o.size].v);
 }
\ No newline at end of file
@@ -7,19 +7,79 @@ typedef enum { ZSON_NULL, ZSON_FALSE, ZSON_TRUE, ZSON_NUMBER, ZSON_STRING, ZSON_
 
 #define ZSON_KEY_NOT_EXIST ((size_t)-1)
 
+#if defined(_MSC_VER)
+typedef __int64 zson_int64;
+typedef unsigned __int64 zson_uint64;
+#elif defined(__GNUC__)
+__extension__ typedef long long zson_int64;
+__extension__ typedef unsigned long long zson_uint64;
+#else
+typedef long long zson_int64;
+typedef unsigned long long zson_uint64;
+#endif
+
 typedef struct zson_value zson_value;
 typedef struct zson_member zson_member;
+typedef struct zson_projection zson_projection;
+typedef struct zson_schema zson_schema;
+typedef struct zson_parser zson_parser;
+typedef struct zson_writer zson_writer;
+
+/*
+ * ZSON_SMALL_VALUES NaN-boxes values into 16 bytes instead of 32 on 64-bit targets: a number is a
+ * plain double, every other value is a quiet NaN carrying its type, flags and a 48-bit data pointer,
+ * and containers keep their capacity in front of their elements or members. The library and the
+ * code using it must be built alike, and the code must go through the accessors or the ZSON_*_OF()
+ * macros below instead of the type, flags, number and pointer fields.
+ */
+#ifdef ZSON_SMALL_VALUES
+struct zson_value {
+    union {
+        double n;                                           /* number, unless it is one of the NaNs below */
+        zson_uint64 tag;                                    /* boxed: type, flags and data pointer */
+    }w;
+    union {
+        struct { size_t size; }o, a;                        /* object or array: member or element count */
+        struct { size_t len; }s;                            /* string: string length */
+        zson_int64 i;                                       /* integral number */
+        zson_uint64 ui;                                     /* integral number above the zson_int64 range */
+    }u;
+};
 
+#define ZSON_BOX_EXPONENT   ((zson_uint64)0x7FF0 << 48)      /* all ones for NaNs and the boxed values */
+#define ZSON_BOX_TYPE       ((zson_uint64)7 << 48)           /* type + 1, zero for infinities and the canonical NaN */
+#define ZSON_BOX_POINTER    (((zson_uint64)1 << 48) - 8)     /* 8-byte aligned data pointer */
+#define ZSON_BOXED(v)       (((v)->w.tag & (ZSON_BOX_EXPONENT | ZSON_BOX_TYPE)) > ZSON_BOX_EXPONENT)
+#define ZSON_TYPE_OF(v)     (ZSON_BOXED(v) ? (zson_type)((((v)->w.tag & ZSON_BOX_TYPE) >> 48) - 1) : ZSON_NUMBER)
+#define ZSON_IS_DOUBLE(v)   (!ZSON_BOXED(v))
+#define ZSON_NUMBER_OF(v)   ((v)->w.n)
+#define ZSON_DATA_OF(v)     ((void*)(size_t)((v)->w.tag & ZSON_BOX_POINTER))
+#define zson_init(v) do { (v)->w.tag = ZSON_BOX_EXPONENT | (zson_uint64)(ZSON_NULL + 1) << 48; } while(0)
+#else
 struct zson_value {
     union {
         struct { zson_member* m; size_t size, capacity; }o; /* object: members, member count, capacity */
         struct { zson_value*  e; size_t size, capacity; }a; /* array:  elements, element count, capacity */
         struct { char* s; size_t len; }s;                   /* string: null-terminated string, string length */
         double n;                                           /* number */
+        zson_int64 i;                                       /* integral number */
+        zson_uint64 ui;                                     /* integral number above the zson_int64 range */
     }u;
     zson_type type;
+    unsigned flags;                                         /* representation of the value, e.g. which number member is used */
 };
 
+#define ZSON_TYPE_OF(v)     ((v)->type)
+#define ZSON_IS_DOUBLE(v)   ((v)->flags == 0)  /* for numbers */
+#define ZSON_NUMBER_OF(v)   ((v)->u.n)
+#define ZSON_DATA_OF(v)     ((void*)(v)->u.s.s)
+#define zson_init(v) do { (v)->type = ZSON_NULL; (v)->flags = 0; } while(0)
+#endif
+
+#define ZSON_STRING_OF(v)   ((char*)ZSON_DATA_OF(v))
+#define ZSON_ELEMENTS_OF(v) ((zson_value*)ZSON_DATA_OF(v))
+#define ZSON_MEMBERS_OF(v)  ((zson_member*)ZSON_DATA_OF(v))
+
 struct zson_member {
     char* k; size_t klen;   /* member key string, key string length */
     zson_value v;           /* member value */
@@ -39,20 +99,325 @@ enum {
     ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET,
     ZSON_PARSE_MISS_KEY,
     ZSON_PARSE_MISS_COLON,
-    ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET
+    ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET,
+    ZSON_PARSE_NESTING_TOO_DEEP,
+    ZSON_PARSE_SCHEMA_MISMATCH,
+    ZSON_PARSE_IO_ERROR,
+    ZSON_PARSE_INVALID_UTF8
 };
 
-#define zson_init(v) do { (v)->type = ZSON_NULL; } while(0)
+/* allocation hooks, each behaves like malloc(), realloc() and free() */
+typedef struct {
+    void* (*allocate)(void* ctx, size_t size);
+    void* (*reallocate)(void* ctx, void* ptr, size_t size);
+    void  (*deallocate)(void* ctx, void* ptr);
+    void* ctx;                          /* passed to every hook */
+}zson_allocator;
+
+/* the global allocator is copied, NULL restores malloc(); not thread-safe, set it before anything is allocated */
+void zson_set_allocator(const zson_allocator* allocator);
+void zson_get_allocator(zson_allocator* allocator);
+
+typedef struct {
+    const zson_projection* projection;  /* members to keep, NULL keeps everything */
+    size_t max_depth;                   /* container nesting limit, 0 uses ZSON_PARSE_MAX_DEPTH (1024) */
+    const zson_allocator* allocator;    /* allocator of the parsed value, NULL uses the global one; must outlive the value */
+    const zson_schema* schema;          /* documents not matching it fail with ZSON_PARSE_SCHEMA_MISMATCH, NULL accepts all */
+    unsigned flags;                     /* ZSON_PARSE_* */
+}zson_parse_options;
+
+void zson_init_parse_options(zson_parse_options* options);
 
 int zson_parse(zson_value* v, const char* json);
+int zson_parse_ex(zson_value* v, const char* json, const zson_parse_options* options);
+/*
+ * Same result as zson_parse(), the children of the root are parsed by up to nthreads threads with
+ * ZSON_THREADS; the allocator of options (or the global one) must then be thread-safe. Options with a
+ * projection or a schema parse serially.
+ */
+int zson_parse_parallel(zson_value* v, const char* json, unsigned nthreads);
+int zson_parse_parallel_ex(zson_value* v, const char* json, unsigned nthreads, const zson_parse_options* options);
+
+#define ZSON_PARSE_FILE_READ   0x1  /* read the file even where it could be mapped */
+#define ZSON_PARSE_STRICT_UTF8 0x2  /* ill-formed UTF-8 in strings fails with ZSON_PARSE_INVALID_UTF8 */
+#define ZSON_PARSE_PACK_ARRAYS 0x4  /* see zson_get_number_array() */
+
+/* Maps the file where possible, else reads it in chunks (pipes too). The file must not shrink meanwhile. */
+int zson_parse_file(zson_value* v, const char* path, unsigned flags);
+int zson_parse_file_ex(zson_value* v, const char* path, const zson_parse_options* options);
+
+/* a parser keeps its scratch stack between calls, use one per thread; handles keep the global allocator they were created with */
+zson_parser* zson_create_parser(void);
+void zson_free_parser(zson_parser* p);
+int zson_parse_with(zson_parser* p, zson_value* v, const char* json, const zson_parse_options* options);
+size_t zson_get_parser_capacity(const zson_parser* p);
+void zson_trim_parser(zson_parser* p, size_t capacity);
+
+/* paths are JSON pointers ("/a/b", "" for the whole document); array elements are transparent */
+zson_projection* zson_create_projection(const char* const* paths, size_t count);
+void zson_free_projection(zson_projection* p);
+
+/*
+ * JSON Schema subset: type, enum, minimum, maximum, maxLength, properties, required and items.
+ * Annotations such as title are ignored, any other keyword fails with NULL.
+ * Members skipped by a projection are neither validated nor count as present.
+ */
+zson_schema* zson_create_schema(const zson_value* schema);
+void zson_free_schema(zson_schema* s);
+
+enum {
+    ZSON_STRINGIFY_ASCII = 1 << 0   /* escape non-ASCII characters as \uXXXX */
+};
+
+typedef struct {
+    unsigned flags;                 /* ZSON_STRINGIFY_* */
+    const zson_allocator* allocator;/* allocator of the returned string, NULL uses the global one */
+}zson_stringify_options;
+
+void zson_init_stringify_options(zson_stringify_options* options);
+
 char* zson_stringify(const zson_value* v, size_t* length);
+char* zson_stringify_ex(const zson_value* v, size_t* length, const zson_stringify_options* options);
+/*
+ * Same output as zson_stringify(), written by up to nthreads threads when built with ZSON_THREADS.
+ * The allocator of options (or the global one) must then be thread-safe, the helper threads use it
+ * for their output too. The caller counts the whole output in bytes_emitted, the other stats and the
+ * traces of the helper threads stay with them.
+ */
+char* zson_stringify_parallel(const zson_value* v, size_t* length, unsigned nthreads);
+char* zson_stringify_parallel_ex(const zson_value* v, size_t* length, unsigned nthreads, const zson_stringify_options* options);
+/* exact output length excluding the terminating null character */
+size_t zson_stringify_size(const zson_value* v);
+size_t zson_stringify_size_ex(const zson_value* v, const zson_stringify_options* options);
+/* writes nothing unless length < capacity, returns length like zson_stringify_size() */
+size_t zson_stringify_into(const zson_value* v, char* buffer, size_t capacity);
+size_t zson_stringify_into_ex(const zson_value* v, char* buffer, size_t capacity, const zson_stringify_options* options);
+
+/* a writer keeps its output buffer between calls, the result is valid until the next call, use one per thread */
+zson_writer* zson_create_writer(void);
+void zson_free_writer(zson_writer* w);
+const char* zson_stringify_with(zson_writer* w, const zson_value* v, size_t* length, const zson_stringify_options* options);
+size_t zson_get_writer_capacity(const zson_writer* w);
+void zson_trim_writer(zson_writer* w, size_t capacity);
+
+/* C struct bindings: a descriptor table lists the struct members mapped to object keys */
+typedef enum {
+    ZSON_FIELD_BOOLEAN,     /* int, 0 or 1 */
+    ZSON_FIELD_INT,         /* int */
+    ZSON_FIELD_INT64,       /* zson_int64 */
+    ZSON_FIELD_DOUBLE,      /* double */
+    ZSON_FIELD_STRING,      /* char*, null-terminated and owned by the struct, NULL for null */
+    ZSON_FIELD_OBJECT       /* nested struct described by fields */
+} zson_field_type;
+
+typedef struct zson_field zson_field;
+
+struct zson_field {
+    const char* key;            /* object key, NULL ends the table */
+    zson_field_type type;
+    size_t offset;              /* offsetof() the member */
+    const zson_field* fields;   /* descriptor of a ZSON_FIELD_OBJECT member */
+};
+
+/*
+ * Parses an object straight into a struct: unknown keys are skipped, missing ones left untouched and
+ * mismatched values fail with ZSON_PARSE_SCHEMA_MISMATCH. String members must start NULL; after a
+ * failure, strings already stored are released by zson_free_struct(). Strings come from the allocator
+ * of options, so pass the same options to zson_free_struct_ex(); projection and schema are ignored.
+ */
+int zson_parse_struct(void* obj, const zson_field* fields, const char* json);
+int zson_parse_struct_ex(void* obj, const zson_field* fields, const char* json, const zson_parse_options* options);
+char* zson_stringify_struct(const void* obj, const zson_field* fields, size_t* length);
+char* zson_stringify_struct_ex(const void* obj, const zson_field* fields, size_t* length, const zson_stringify_options* options);
+void zson_free_struct(void* obj, const zson_field* fields);
+void zson_free_struct_ex(void* obj, const zson_field* fields, const zson_parse_options* options);
 
+/* deep copy, each block from the allocator of the block it copies; neither frozen nor compacted */
 void zson_copy(zson_value* dst, const zson_value* src);
+/*
+ * O(1): the copy shares the strings, elements and members of src, the mutators copy only the blocks
+ * on the path they modify. The element and member getters returning a zson_value* count as mutators,
+ * the caller may write through them; read with their _const variants, which stay O(1) and never
+ * copy. Change shared values only through the API, never the fields, and keep a value being changed
+ * on one thread. Without GCC or MSVC atomics, all values sharing blocks must stay on one thread.
+ */
+void zson_copy_shared(zson_value* dst, const zson_value* src);
 void zson_move(zson_value* dst, zson_value* src);
 void zson_swap(zson_value* lhs, zson_value* rhs);
 
+/*
+ * Read-only documents: trims every container to its size and sorts the members of every object by
+ * key, so lookups are binary searches. Frozen values and their copies must not be modified; read
+ * them, acquired documents too, with the _const getters.
+ */
+void zson_freeze(zson_value* v);
+int zson_is_frozen(const zson_value* v);
+
+/*
+ * Rewrites the strings, elements, members and keys of v into one block in depth-first order, with
+ * no spare capacity, so walks touch fewer cache lines. Values stay where they are; growing a
+ * container or changing its keys copies it out again. Freeze before compacting, not after.
+ * The block comes from the allocator of v's own string, elements or members.
+ */
+void zson_compact(zson_value* v);
+
+/*
+ * Lock-free hot swapping of a document. Readers zson_acquire() the current one and hand the ticket
+ * back to zson_release_acquired() when done. zson_publish() freezes and takes v, then waits until no
+ * reader can still see the previous document before freeing it. One publisher at a time.
+ */
+typedef struct zson_cell zson_cell;
+zson_cell* zson_create_cell(void);
+void zson_free_cell(zson_cell* c);
+void zson_publish(zson_cell* c, zson_value* v);
+const zson_value* zson_acquire(zson_cell* c, unsigned* ticket);
+void zson_release_acquired(zson_cell* c, unsigned ticket);
+
+/*
+ * Arrays of objects with the same keys as a table of columns: each column keeps its key once and the
+ * values of all rows in an array, packed when they are homogeneous numbers (see zson_get_number_array()).
+ * zson_create_table() returns NULL and zson_parse_table() sets no table if the rows differ in keys.
+ * A table and the values it builds use the allocator of v's elements or of options.
+ */
+typedef struct zson_table zson_table;
+zson_table* zson_create_table(const zson_value* v);
+int zson_parse_table(zson_table** t, const char* json);
+int zson_parse_table_ex(zson_table** t, const char* json, const zson_parse_options* options);
+void zson_free_table(zson_table* t);
+size_t zson_get_table_rows(const zson_table* t);
+size_t zson_get_table_columns(const zson_table* t);
+const char* zson_get_column_key(const zson_table* t, size_t column);
+size_t zson_get_column_key_length(const zson_table* t, size_t column);
+size_t zson_find_column(const zson_table* t, const char* key, size_t klen);
+const zson_value* zson_get_column(const zson_table* t, size_t column);
+void zson_table_to_value(zson_value* v, const zson_table* t);
+char* zson_stringify_table(const zson_table* t, size_t* length);
+
+/*
+ * Flat parse result: one 64-bit word per value in document order (numbers and strings add a second
+ * one), where arrays and objects record the word of their end. String bytes go to a side buffer, so
+ * parsing allocates twice, each sized from the input. Cursors walk it without allocating.
+ * The tape and the values built from it use the allocator of options; projection and schema are ignored.
+ */
+typedef struct zson_tape zson_tape;
+typedef struct {
+    const zson_tape* t;
+    size_t i;                   /* word of the value */
+    size_t k;                   /* word of its key, 0 unless it is a member */
+}zson_cursor;
+
+int zson_parse_tape(zson_tape** t, const char* json);
+int zson_parse_tape_ex(zson_tape** t, const char* json, const zson_parse_options* options);
+void zson_free_tape(zson_tape* t);
+void zson_get_tape_root(const zson_tape* t, zson_cursor* c);
+zson_type zson_get_cursor_type(const zson_cursor* c);
+double zson_get_cursor_number(const zson_cursor* c);
+zson_int64 zson_get_cursor_int64(const zson_cursor* c);
+const char* zson_get_cursor_string(const zson_cursor* c, size_t* length);
+/* elements of an array or members of an object */
+size_t zson_get_cursor_size(const zson_cursor* c);
+const char* zson_get_cursor_key(const zson_cursor* c, size_t* length);
+/* these move the cursor and return 1, or leave it and return 0 if there is no such value */
+int zson_cursor_first(zson_cursor* c);
+int zson_cursor_next(zson_cursor* c);
+int zson_cursor_find(zson_cursor* c, const char* key, size_t klen);
+/* build the value under the cursor as a tree, e.g. to modify it */
+void zson_cursor_to_value(zson_value* v, const zson_cursor* c);
+
+/*
+ * Pull parsing: zson_reader_next() returns the document one token at a time, reading files in fixed
+ * chunks, so memory is bounded by the nesting depth and the longest string, not the document size.
+ * The reader and the values it reads use the allocator of options; projection and schema are ignored.
+ */
+typedef enum {
+    ZSON_TOKEN_END,             /* the document is complete */
+    ZSON_TOKEN_ERROR,           /* see zson_get_reader_error(), every later call returns it again */
+    ZSON_TOKEN_NULL,
+    ZSON_TOKEN_FALSE,
+    ZSON_TOKEN_TRUE,
+    ZSON_TOKEN_NUMBER,
+    ZSON_TOKEN_STRING,
+    ZSON_TOKEN_START_ARRAY,
+    ZSON_TOKEN_END_ARRAY,
+    ZSON_TOKEN_START_OBJECT,
+    ZSON_TOKEN_END_OBJECT,
+    ZSON_TOKEN_KEY              /* followed by the tokens of the member's value */
+}zson_token;
+
+typedef struct zson_reader zson_reader;
+/* the text is read in place and must outlive the reader */
+zson_reader* zson_create_reader(const char* json);
+zson_reader* zson_create_reader_ex(const char* json, const zson_parse_options* options);
+/* NULL if the file cannot be opened */
+zson_reader* zson_open_reader(const char* path);
+zson_reader* zson_open_reader_ex(const char* path, const zson_parse_options* options);
+void zson_free_reader(zson_reader* r);
+zson_token zson_reader_next(zson_reader* r);
+/*
+ * Both act on the last token: after a key its value, after an opening bracket everything up to the
+ * closing one, which becomes the last token. zson_reader_skip() only matches quotes and brackets.
+ * After a closing bracket or the end there is no value to read: ZSON_PARSE_EXPECT_VALUE.
+ */
+int zson_reader_skip(zson_reader* r);
+int zson_reader_read_value(zson_reader* r, zson_value* v);
+int zson_get_reader_error(const zson_reader* r);
+/* of the last KEY or STRING token, valid until the next call on the reader */
+const char* zson_get_reader_string(const zson_reader* r, size_t* length);
+double zson_get_reader_number(const zson_reader* r);
+zson_int64 zson_get_reader_int64(const zson_reader* r);
+
+/* every block records the allocator it came from, so the mutators and this use the per-call allocator too */
 void zson_free(zson_value* v);
 
+typedef struct {
+    size_t nodes;           /* element and member slots in use */
+    size_t keys;            /* member keys including their null characters */
+    size_t strings;         /* string values including their null characters */
+    size_t unused;          /* reserved but unused element and member slots */
+}zson_memory;
+
+/* heap bytes held by a value, not counting the value itself; usage may be NULL */
+size_t zson_memory_usage(const zson_value* v, zson_memory* usage);
+
+typedef struct {
+    size_t allocs;          /* allocate() calls */
+    size_t reallocs;        /* reallocate() calls */
+    size_t stack_growths;   /* parse, stringify and tree walk stack growths */
+    size_t bytes_parsed;    /* JSON text consumed by the parsers */
+    size_t bytes_emitted;   /* JSON text produced by the stringifiers */
+}zson_stats;
+
+/* counters of the calling thread, all zero unless built with ZSON_STATS */
+void zson_get_stats(zson_stats* stats);
+void zson_reset_stats(void);
+
+typedef enum {
+    ZSON_TRACE_PARSE_STRING, ZSON_TRACE_PARSE_NUMBER, ZSON_TRACE_PARSE_ARRAY, ZSON_TRACE_PARSE_OBJECT,
+    ZSON_TRACE_STRINGIFY_STRING, ZSON_TRACE_STRINGIFY_NUMBER, ZSON_TRACE_STRINGIFY_ARRAY, ZSON_TRACE_STRINGIFY_OBJECT,
+    ZSON_TRACE_STACK_GROWTH,
+    ZSON_TRACE_KINDS
+} zson_trace_kind;
+
+typedef struct {
+    size_t count[ZSON_TRACE_KINDS];     /* finished events, strings include member keys */
+    size_t bytes[ZSON_TRACE_KINDS];     /* JSON text consumed or produced, the new stack size for growths */
+    double seconds[ZSON_TRACE_KINDS];   /* wall time, containers include their children */
+    size_t escapes_parsed;              /* escape sequences decoded by the parsers */
+    size_t escapes_emitted;             /* escape sequences written by the stringifiers */
+}zson_trace;
+
+/* hooks are called around every event, end() also when a parse error abandons it */
+typedef struct {
+    void (*begin)(void* ctx, zson_trace_kind kind);
+    void (*end)(void* ctx, zson_trace_kind kind, size_t bytes);
+    void* ctx;
+}zson_trace_hooks;
+
+/* tracing of the calling thread, nothing is recorded unless built with ZSON_TRACE; hooks are global, NULL removes them */
+void zson_get_trace(zson_trace* trace);
+void zson_reset_trace(void);
+void zson_set_trace_hooks(const zson_trace_hooks* hooks);
+
 zson_type zson_get_type(const zson_value* v);
 int zson_is_equal(const zson_value* lhs, const zson_value* rhs);
 
@@ -63,6 +428,12 @@ void zson_set_boolean(zson_value* v, int b);
 
 double zson_get_number(const zson_value* v);
 void zson_set_number(zson_value* v, double n);
+/* integer literals without fraction or exponent are kept exactly, getters convert and saturate */
+int zson_is_integer(const zson_value* v);
+zson_int64 zson_get_int64(const zson_value* v);
+void zson_set_int64(zson_value* v, zson_int64 i);
+zson_uint64 zson_get_uint64(const zson_value* v);
+void zson_set_uint64(zson_value* v, zson_uint64 u);
 
 const char* zson_get_string(const zson_value* v);
 size_t zson_get_string_length(const zson_value* v);
@@ -75,10 +446,21 @@ void zson_reserve_array(zson_value* v, size_t capacity);
 void zson_shrink_array(zson_value* v);
 void zson_clear_array(zson_value* v);
 zson_value* zson_get_array_element(zson_value* v, size_t index);
+/* elements of packed arrays are made up in scratch */
+const zson_value* zson_get_array_element_const(const zson_value* v, size_t index, zson_value* scratch);
 zson_value* zson_pushback_array_element(zson_value* v);
 void zson_popback_array_element(zson_value* v);
 zson_value* zson_insert_array_element(zson_value* v, size_t index);
 void zson_erase_array_element(zson_value* v, size_t index, size_t count);
+/*
+ * With ZSON_PARSE_PACK_ARRAYS, or after zson_pack_array(), arrays of only floating point or only
+ * integral numbers are kept in packed buffers, which these expose for bulk processing. They return 0
+ * unless v is packed that way. Writable access to the elements as zson_value and any modification
+ * unpack the array first, so a packed array is not read-only.
+ */
+int zson_get_number_array(const zson_value* v, const double** numbers, size_t* size);
+int zson_get_int64_array(const zson_value* v, const zson_int64** numbers, size_t* size);
+int zson_pack_array(zson_value* v);
 
 void zson_set_object(zson_value* v, size_t capacity);
 size_t zson_get_object_size(const zson_value* v);
@@ -89,9 +471,87 @@ void zson_clear_object(zson_value* v);
 const char* zson_get_object_key(const zson_value* v, size_t index);
 size_t zson_get_object_key_length(const zson_value* v, size_t index);
 zson_value* zson_get_object_value(zson_value* v, size_t index);
+const zson_value* zson_get_object_value_const(const zson_value* v, size_t index);
 size_t zson_find_object_index(const zson_value* v, const char* key, size_t klen);
 zson_value* zson_find_object_value(zson_value* v, const char* key, size_t klen);
+const zson_value* zson_find_object_value_const(const zson_value* v, const char* key, size_t klen);
 zson_value* zson_set_object_value(zson_value* v, const char* key, size_t klen);
 void zson_remove_object_value(zson_value* v, size_t index);
 
+/*
+ * With ZSON_INLINE_ACCESSORS defined, the getters below that only read a field are expanded in the
+ * caller, the functions in Zson.c remain for everything else. Element and member value getters stay
+ * out of line: the writable ones may copy a shared container or unpack an array first.
+ */
+#if defined(ZSON_INLINE_ACCESSORS) && !defined(ZSON_IMPLEMENTATION)
+#include <assert.h> /* assert() */
+
+#if defined(__GNUC__)
+#define ZSON_INLINE static __inline__
+#elif defined(_MSC_VER)
+#define ZSON_INLINE static __inline
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
+#define ZSON_INLINE static inline
+#else
+#define ZSON_INLINE static
+#endif
+
+ZSON_INLINE zson_type zson_inline_get_type(const zson_value* v) {
+    assert(v != NULL);
+    return ZSON_TYPE_OF(v);
+}
+
+ZSON_INLINE int zson_inline_get_boolean(const zson_value* v) {
+    assert(v != NULL && (ZSON_TYPE_OF(v) == ZSON_TRUE || ZSON_TYPE_OF(v) == ZSON_FALSE));
+    return ZSON_TYPE_OF(v) == ZSON_TRUE;
+}
+
+ZSON_INLINE double zson_inline_get_number(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_NUMBER);
+    return ZSON_IS_DOUBLE(v) ? ZSON_NUMBER_OF(v) : (zson_get_number)(v);  /* integers are converted out of line */
+}
+
+ZSON_INLINE const char* zson_inline_get_string(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_STRING);
+    return ZSON_STRING_OF(v);
+}
+
+ZSON_INLINE size_t zson_inline_get_string_length(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_STRING);
+    return v->u.s.len;
+}
+
+ZSON_INLINE size_t zson_inline_get_array_size(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_ARRAY);
+    return v->u.a.size;
+}
+
+ZSON_INLINE size_t zson_inline_get_object_size(const zson_value* v) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
+    return v->u.o.size;
+}
+
+ZSON_INLINE const char* zson_inline_get_object_key(const zson_value* v, size_t index) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
+    assert(index < v->u.o.size);
+    return ZSON_MEMBERS_OF(v)[index].k;
+}
+
+ZSON_INLINE size_t zson_inline_get_object_key_length(const zson_value* v, size_t index) {
+    assert(v != NULL && ZSON_TYPE_OF(v) == ZSON_OBJECT);
+    assert(index < v->u.o.size);
+    return ZSON_MEMBERS_OF(v)[index].klen;
+}
+
+#define zson_get_type(v)                 zson_inline_get_type(v)
+#define zson_get_boolean(v)              zson_inline_get_boolean(v)
+#define zson_get_number(v)               zson_inline_get_number(v)
+#define zson_get_string(v)               zson_inline_get_string(v)
+#define zson_get_string_length(v)        zson_inline_get_string_length(v)
+#define zson_get_array_size(v)           zson_inline_get_array_size(v)
+#define zson_get_object_size(v)          zson_inline_get_object_size(v)
+#define zson_get_object_key(v, i)        zson_inline_get_object_key(v, i)
+#define zson_get_object_key_length(v, i) zson_inline_get_object_key_length(v, i)
+#endif /* ZSON_INLINE_ACCESSORS */
+
 #endif /* ZSON_H__ */
\ No newline at end of file
@@ -5,7 +5,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef ZSON_TEST_AMALGAMATED
+#define ZSON_IMPLEMENTATION  /* the library is compiled in from the single header */
+#include "zson_amalgamated.h"
+#else
 #include "Zson.h"
+#endif
 
 static int main_ret = 0;
 static int test_count = 0;
@@ -104,6 +109,46 @@ static void test_parse_number() {
     TEST_NUMBER(-1.7976931348623157e+308, "-1.7976931348623157e+308");
 }
 
+#define TEST_INTEGER(expect, json)\
+    do {\
+        zson_value v;\
+        zson_init(&v);\
+        EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, json));\
+        EXPECT_EQ_INT(ZSON_NUMBER, zson_get_type(&v));\
+        EXPECT_TRUE(zson_is_integer(&v));\
+        EXPECT_TRUE(zson_get_int64(&v) == (expect));\
+        zson_free(&v);\
+    } while(0)
+
+static void test_parse_integer() {
+    zson_value v;
+    zson_int64 max = (zson_int64)(((zson_uint64)-1) >> 1);
+    TEST_INTEGER(0, "0");
+    TEST_INTEGER(1, "1");
+    TEST_INTEGER(-1, "-1");
+    TEST_INTEGER(1234567890, "1234567890");
+    TEST_INTEGER(max, "9223372036854775807");
+    TEST_INTEGER(-max - 1, "-9223372036854775808");
+    TEST_INTEGER((zson_int64)9007199254740992.0 + 1, "9007199254740993"); /* 2^53 + 1 */
+
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "18446744073709551615"));
+    EXPECT_TRUE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_uint64(&v) == (zson_uint64)-1);
+    EXPECT_TRUE(zson_get_int64(&v) == max);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "18446744073709551616"));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_EQ_DOUBLE(18446744073709551616.0, zson_get_number(&v));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "-9223372036854775809"));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "-0"));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "1.0"));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_int64(&v) == 1);
+    zson_free(&v);
+}
+
 #define TEST_STRING(expect, json)\
     do {\
         zson_value v;\
@@ -167,6 +212,23 @@ static void test_parse_array() {
     zson_free(&v);
 }
 
+static void test_parse_whitespace() {
+    zson_value v;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v,
+        "{\n"
+        "                                    \"a\" :\t\t[\r\n"
+        "                                        1,\n"
+        "                                        { }\n"
+        "                                    ]\n"
+        "}                                                          \n"));
+    EXPECT_EQ_SIZE_T(2, zson_get_array_size(zson_find_object_value(&v, "a", 1)));
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_ROOT_NOT_SINGULAR, zson_parse(&v, "[ ]                  \f"));
+    EXPECT_EQ_INT(ZSON_PARSE_INVALID_VALUE, zson_parse(&v, "                      \v1"));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_parse(&v, "                                  "));
+}
+
 static void test_parse_object() {
     zson_value v;
     size_t i;
@@ -230,7 +292,7 @@ static void test_parse_object() {
     do {\
         zson_value v;\
         zson_init(&v);\
-        v.type = ZSON_FALSE;\
+        zson_set_boolean(&v, 0);\
         EXPECT_EQ_INT(error, zson_parse(&v, json));\
         EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));\
         zson_free(&v);\
@@ -315,6 +377,43 @@ static void test_parse_invalid_unicode_surrogate() {
     TEST_PARSE_ERROR(ZSON_PARSE_INVALID_UNICODE_SURROGATE, "\"\\uD800\\uE000\"");
 }
 
+#define TEST_PARSE_UTF8(expect, json)\
+    do {\
+        zson_parse_options options;\
+        zson_value v;\
+        zson_init_parse_options(&options);\
+        options.flags = ZSON_PARSE_STRICT_UTF8;\
+        zson_init(&v);\
+        EXPECT_EQ_INT(expect, zson_parse_ex(&v, json, &options));\
+        zson_free(&v);\
+        EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, json));\
+        zson_free(&v);\
+    } while(0)
+
+static void test_parse_invalid_utf8() {
+    static const char long_string[] = "0123456789ABCDEF0123456789\xC2\xA2\n0123456789ABCDEF\xF0\x9F\x98\x80";
+    zson_parse_options options;
+    zson_value v;
+    TEST_PARSE_UTF8(ZSON_PARSE_OK, "\"\xC2\xA2 \xE2\x82\xAC \xED\x9F\xBF \xEF\xBF\xBD \xF4\x8F\xBF\xBF\"");
+    TEST_PARSE_UTF8(ZSON_PARSE_OK, "{\"\xE2\x82\xAC\":\"0123456789ABCDEF0123456789\xC2\xA2\\n0123456789ABCDEF\xF0\x9F\x98\x80\"}");
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\x80\"");
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xC0\x80\"");             /* overlong */
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xE0\x9F\xBF\"");
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xED\xA0\x80\"");         /* surrogate */
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xF4\x90\x80\x80\"");     /* above U+10FFFF */
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xF5\x80\x80\x80\"");
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "\"\xE2\x82\"");             /* truncated */
+    TEST_PARSE_UTF8(ZSON_PARSE_INVALID_UTF8, "{\"0123456789ABCDEF0123456789\xFF\":1}");
+
+    zson_init_parse_options(&options);
+    options.flags = ZSON_PARSE_STRICT_UTF8;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_QUOTATION_MARK, zson_parse_ex(&v, "\"\xE2\x82\xAC", &options));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[\"0123456789ABCDEF0123456789\xC2\xA2\\n0123456789ABCDEF\xF0\x9F\x98\x80\"]", &options));
+    EXPECT_EQ_STRING(long_string, zson_get_string(zson_get_array_element(&v, 0)), zson_get_string_length(zson_get_array_element(&v, 0)));
+    zson_free(&v);
+}
+
 static void test_parse_miss_comma_or_square_bracket() {
     TEST_PARSE_ERROR(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1");
     TEST_PARSE_ERROR(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[1}");
@@ -345,14 +444,252 @@ static void test_parse_miss_comma_or_curly_bracket() {
     TEST_PARSE_ERROR(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":{}");
 }
 
+static void test_parse_projection() {
+    static const char* paths[] = { "/id", "/user/name", "/items/v", "/a~1b" };
+    zson_parse_options opt;
+    zson_projection* p;
+    zson_value v, *e;
+    char* json;
+    size_t length;
+
+    p = zson_create_projection(paths, 4);
+    EXPECT_TRUE(p != NULL);
+    zson_init_parse_options(&opt);
+    opt.projection = p;
+
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v,
+        "{ \"skip\" : [ { \"x\" : \"]}\\\"\" }, [ 1, 2 ] ], "
+        "\"id\" : 7, "
+        "\"user\" : { \"name\" : \"z\", \"age\" : 3 }, "
+        "\"items\" : [ { \"v\" : 1, \"w\" : 2 }, { \"w\" : 3 } ], "
+        "\"a/b\" : { \"c\" : true }, "
+        "\"tail\" : null }", &opt));
+    json = zson_stringify(&v, &length);
+    EXPECT_EQ_STRING("{\"id\":7,\"user\":{\"name\":\"z\"},\"items\":[{\"v\":1},{}],\"a/b\":{\"c\":true}}", json, length);
+    free(json);
+    e = zson_find_object_value(&v, "id", 2);
+    EXPECT_TRUE(e != NULL);
+    zson_free(&v);
+
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_QUOTATION_MARK, zson_parse_ex(&v, "{\"x\":\"abc", &opt));
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse_ex(&v, "{\"x\":[1}", &opt));
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, zson_parse_ex(&v, "{\"x\":{\"y\":1", &opt));
+    EXPECT_EQ_INT(ZSON_PARSE_INVALID_VALUE, zson_parse_ex(&v, "{\"x\":}", &opt));
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, zson_parse_ex(&v, "{\"x\":1 2}", &opt));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+    zson_free(&v);
+    zson_free_projection(p);
+
+    p = zson_create_projection(paths, 0);
+    EXPECT_TRUE(p != NULL);
+    opt.projection = p;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[{\"a\":1},2]", &opt));
+    EXPECT_EQ_SIZE_T(0, zson_get_object_size(zson_get_array_element(&v, 0)));
+    zson_free(&v);
+    zson_free_projection(p);
+    paths[0] = "id";
+    EXPECT_TRUE(zson_create_projection(paths, 1) == NULL);
+    paths[0] = "/~2";
+    EXPECT_TRUE(zson_create_projection(paths, 1) == NULL);
+}
+
+static void test_parse_nesting_too_deep() {
+    zson_parse_options opt;
+    zson_value v;
+    char json[1026];
+    zson_init_parse_options(&opt);
+    opt.max_depth = 2;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[[1],{\"a\":2}]", &opt));
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_NESTING_TOO_DEEP, zson_parse_ex(&v, "[[[]]]", &opt));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+    EXPECT_EQ_INT(ZSON_PARSE_NESTING_TOO_DEEP, zson_parse_ex(&v, "{\"a\":[1,{\"b\":2}]}", &opt));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+    memset(json, '[', sizeof(json) - 1);   /* default limit is 1024 */
+    json[sizeof(json) - 1] = '\0';
+    EXPECT_EQ_INT(ZSON_PARSE_NESTING_TOO_DEEP, zson_parse(&v, json));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_parse(&v, json + 1));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+}
+
+static void test_parse_with_parser() {
+    zson_parser* p = zson_create_parser();
+    zson_value v;
+    size_t capacity;
+    zson_init(&v);
+    EXPECT_EQ_SIZE_T(0, zson_get_parser_capacity(p));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_with(p, &v, "[\"abc\",{\"k\":[1,2,3]}]", NULL));
+    EXPECT_EQ_SIZE_T(2, zson_get_array_size(&v));
+    capacity = zson_get_parser_capacity(p);
+    EXPECT_TRUE(capacity > 0);
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse_with(p, &v, "[1 2]", NULL));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_with(p, &v, "[\"def\"]", NULL));
+    EXPECT_EQ_SIZE_T(capacity, zson_get_parser_capacity(p));
+    zson_free(&v);
+    zson_trim_parser(p, 0);
+    EXPECT_EQ_SIZE_T(0, zson_get_parser_capacity(p));
+    EXPECT_EQ_INT(ZSON_PARSE_ROOT_NOT_SINGULAR, zson_parse_with(p, &v, "[\"def\"] x", NULL));
+    zson_free(&v);
+    zson_free_parser(p);
+}
+
+#define TEST_SCHEMA(expect, json)\
+    do {\
+        zson_value v;\
+        zson_init(&v);\
+        EXPECT_EQ_INT(expect, zson_parse_ex(&v, json, &opt));\
+        if (expect != ZSON_PARSE_OK)\
+            EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));\
+        zson_free(&v);\
+    } while(0)
+
+static void test_parse_schema() {
+    zson_parse_options opt;
+    zson_value schema;
+    zson_init(&schema);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&schema,
+        "{\"title\":\"order\",\"type\":\"object\",\"required\":[\"id\",\"items\"],\"properties\":{"
+            "\"id\":{\"type\":\"integer\",\"minimum\":1},"
+            "\"state\":{\"enum\":[\"open\",\"closed\",null]},"
+            "\"note\":{\"type\":[\"string\",\"null\"],\"maxLength\":3},"
+            "\"items\":{\"type\":\"array\",\"items\":{\"type\":\"number\",\"maximum\":10}}}}"));
+    zson_init_parse_options(&opt);
+    opt.schema = zson_create_schema(&schema);
+    EXPECT_TRUE(opt.schema != NULL);
+
+    TEST_SCHEMA(ZSON_PARSE_OK, "{\"id\":1,\"items\":[]}");
+    TEST_SCHEMA(ZSON_PARSE_OK, "{\"items\":[1.5,10],\"id\":2e0,\"state\":null,\"note\":\"\\u00e9t\\u00e9\",\"extra\":{}}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "[]");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":0,\"items\":[]}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1.5,\"items\":[]}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1,\"items\":[1,11]}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1,\"items\":{}}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1,\"items\":[],\"state\":\"lost\"}");
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":1,\"items\":[],\"note\":\"four\"}");
+    /* rejected before the rest of the document is looked at */
+    TEST_SCHEMA(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":\"1\",\"items\":[");
+    TEST_SCHEMA(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"id\":1 \"items\":[]}");
+    zson_free_schema((zson_schema*)opt.schema);
+    zson_free(&schema);
+
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&schema, "{\"type\":\"object\",\"additionalProperties\":false}"));
+    EXPECT_TRUE(zson_create_schema(&schema) == NULL);
+    zson_free(&schema);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&schema, "{\"type\":\"decimal\"}"));
+    EXPECT_TRUE(zson_create_schema(&schema) == NULL);
+    zson_free(&schema);
+}
+
+#define TEST_PARSE_PARALLEL(json, nthreads)\
+    do {\
+        zson_value v1, v2;\
+        int ret;\
+        zson_init(&v1);\
+        zson_init(&v2);\
+        ret = zson_parse(&v1, json);\
+        EXPECT_EQ_INT(ret, zson_parse_parallel(&v2, json, nthreads));\
+        if (ret == ZSON_PARSE_OK)\
+            EXPECT_TRUE(zson_is_equal(&v1, &v2));\
+        zson_free(&v1);\
+        zson_free(&v2);\
+    } while(0)
+
+static void test_parse_parallel() {
+    static const char mixed[] = " [ 1 , [2,3], {\"a\":[4,\",]\"]}, \"x\\\",y\", null,true , -5e3 ] ";
+    const double* d;
+    size_t n;
+    zson_value v;
+    TEST_PARSE_PARALLEL("1", 4);
+    TEST_PARSE_PARALLEL("[]", 4);
+    TEST_PARSE_PARALLEL("[1]", 4);
+    TEST_PARSE_PARALLEL(mixed, 2);
+    TEST_PARSE_PARALLEL(mixed, 3);
+    TEST_PARSE_PARALLEL(mixed, 64);
+    TEST_PARSE_PARALLEL("{\"a\":1,\"b\":[2,{\"c\":3}],\"d\":\"e,f\",\"g\":{}}", 3);
+    TEST_PARSE_PARALLEL("[1,2,]", 3);
+    TEST_PARSE_PARALLEL("[1,,2,3]", 3);
+    TEST_PARSE_PARALLEL("[1,2,3", 3);
+    TEST_PARSE_PARALLEL("[1,2,3] x", 3);
+    TEST_PARSE_PARALLEL("[1,2,3]]", 3);
+    TEST_PARSE_PARALLEL("[1,\"\\x\",3,4]", 3);
+    TEST_PARSE_PARALLEL("[1,2 3,4,5]", 3);
+    TEST_PARSE_PARALLEL("{\"a\":1,\"b\"2,\"c\":3}", 3);
+    TEST_PARSE_PARALLEL("{\"a\":1,2:3,\"c\":3}", 3);
+    TEST_PARSE_PARALLEL("{\"a\":1,\"b\":2,\"c\":3,}", 3);
+    TEST_PARSE_PARALLEL("[1,2,\"abc]", 3);
+    for (n = 2; n <= 4; n++) {
+        TEST_PARSE_PARALLEL("[1,2}", (unsigned)n);
+        TEST_PARSE_PARALLEL("{\"a\":1,\"b\":2]", (unsigned)n);
+        TEST_PARSE_PARALLEL("[{\"a\":1},{\"b\":2}}", (unsigned)n);
+        TEST_PARSE_PARALLEL("[[1},2]", (unsigned)n);
+    }
+
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_parallel(&v, "[0.5,1.5,2.5,3.5,4.5,5.5]", 3));
+    EXPECT_FALSE(zson_get_number_array(&v, &d, &n));
+    EXPECT_EQ_SIZE_T(6, zson_get_array_size(&v));
+    zson_free(&v);
+}
+
+static void test_parse_file() {
+    static const char path[] = "zson_test_parse_file.json";
+    zson_value v;
+    FILE* fp;
+    size_t i;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_IO_ERROR, zson_parse_file(&v, "zson_test_no_such_file.json", 0));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v));
+
+    fp = fopen(path, "wb");
+    fputs(" {\"a\":[1,2,\"x\"]} ", fp);
+    fclose(fp);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file(&v, path, 0));
+    EXPECT_EQ_SIZE_T(3, zson_get_array_size(zson_find_object_value(&v, "a", 1)));
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file(&v, path, ZSON_PARSE_FILE_READ));
+    EXPECT_EQ_INT(ZSON_OBJECT, zson_get_type(&v));
+    zson_free(&v);
+
+    /* whole pages and more than one read chunk, then the same text cut short */
+    fp = fopen(path, "wb");
+    fputs(" [", fp);
+    for (i = 0; i < 65536 / 2 - 2; i++)
+        fputs("0,", fp);
+    fputs("1]", fp);
+    fclose(fp);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file(&v, path, 0));
+    EXPECT_EQ_SIZE_T(65536 / 2 - 1, zson_get_array_size(&v));
+    zson_free(&v);
+    fp = fopen(path, "wb");
+    fputs("[1,2", fp);
+    fclose(fp);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse_file(&v, path, 0));
+    fp = fopen(path, "wb");
+    fputs("[\"\xC0\xAF\"]", fp);
+    fclose(fp);
+    EXPECT_EQ_INT(ZSON_PARSE_INVALID_UTF8, zson_parse_file(&v, path, ZSON_PARSE_STRICT_UTF8));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file(&v, path, 0));
+    zson_free(&v);
+    remove(path);
+}
+
 static void test_parse() {
     test_parse_null();
     test_parse_true();
     test_parse_false();
     test_parse_number();
+    test_parse_integer();
     test_parse_string();
     test_parse_array();
     test_parse_object();
+    test_parse_whitespace();
 
     test_parse_expect_value();
     test_parse_invalid_value();
@@ -363,10 +700,17 @@ static void test_parse() {
     test_parse_invalid_string_char();
     test_parse_invalid_unicode_hex();
     test_parse_invalid_unicode_surrogate();
+    test_parse_invalid_utf8();
     test_parse_miss_comma_or_square_bracket();
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
+    test_parse_projection();
+    test_parse_nesting_too_deep();
+    test_parse_with_parser();
+    test_parse_schema();
+    test_parse_parallel();
+    test_parse_file();
 }
 
 #define TEST_ROUNDTRIP(json)\
@@ -378,6 +722,7 @@ static void test_parse() {
         EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, json));\
         json2 = zson_stringify(&v, &length);\
         EXPECT_EQ_STRING(json, json2, length);\
+        EXPECT_EQ_SIZE_T(length, zson_stringify_size(&v));\
         zson_free(&v);\
         free(json2);\
     } while(0)
@@ -403,6 +748,13 @@ static void test_stringify_number() {
     TEST_ROUNDTRIP("-2.2250738585072014e-308");
     TEST_ROUNDTRIP("1.7976931348623157e+308");  /* Max double */
     TEST_ROUNDTRIP("-1.7976931348623157e+308");
+
+    TEST_ROUNDTRIP("10");
+    TEST_ROUNDTRIP("-99");
+    TEST_ROUNDTRIP("9007199254740993");  /* 2^53 + 1 */
+    TEST_ROUNDTRIP("9223372036854775807");
+    TEST_ROUNDTRIP("-9223372036854775808");
+    TEST_ROUNDTRIP("18446744073709551615");
 }
 
 static void test_stringify_string() {
@@ -413,6 +765,54 @@ static void test_stringify_string() {
     TEST_ROUNDTRIP("\"Hello\\u0000World\"");
 }
 
+static void test_stringify_long_string() {
+    TEST_ROUNDTRIP("\"0123456789abcdef0123456789abcdef\"");
+    TEST_ROUNDTRIP("\"0123456789abcdef\\n0123456789abcdef\\\"x\"");
+    TEST_ROUNDTRIP("\"0123456789abcde\\\\0123456789abcdef0123456789abcde\\u001F\"");
+    TEST_ROUNDTRIP("\"0123456789abcdef\xE2\x82\xAC" "0123456789abcdef\"");
+}
+
+static void test_stringify_escape_growth() {
+    zson_value v;
+    char s[200], *json;
+    size_t i, length;
+    for (i = 0; i < sizeof(s); i++)
+        s[i] = (char)(i % 2 == 0 ? 0x01 : 'a');
+    zson_init(&v);
+    zson_set_string(&v, s, sizeof(s));
+    json = zson_stringify(&v, &length);
+    EXPECT_EQ_SIZE_T(2 + 100 * 7, length);
+    EXPECT_EQ_SIZE_T(length, zson_stringify_size(&v));
+    EXPECT_TRUE(memcmp(json, "\"\\u0001a", 8) == 0 && memcmp(json + length - 8, "\\u0001a\"", 8) == 0);
+    zson_free(&v);
+    free(json);
+}
+
+#define TEST_STRINGIFY_ASCII(expect, str)\
+    do {\
+        zson_value v;\
+        zson_stringify_options opt;\
+        char* json;\
+        size_t length;\
+        zson_init(&v);\
+        zson_set_string(&v, str, sizeof(str) - 1);\
+        zson_init_stringify_options(&opt);\
+        opt.flags = ZSON_STRINGIFY_ASCII;\
+        json = zson_stringify_ex(&v, &length, &opt);\
+        EXPECT_EQ_STRING(expect, json, length);\
+        EXPECT_EQ_SIZE_T(length, zson_stringify_size_ex(&v, &opt));\
+        zson_free(&v);\
+        free(json);\
+    } while(0)
+
+static void test_stringify_ascii() {
+    TEST_STRINGIFY_ASCII("\"Hello\"", "Hello");
+    TEST_STRINGIFY_ASCII("\"\\u00A2\\u20AC\\uD834\\uDD1E\"", "\xC2\xA2\xE2\x82\xAC\xF0\x9D\x84\x9E");
+    TEST_STRINGIFY_ASCII("\"0123456789abcdef\\u20AC\\n\"", "0123456789abcdef\xE2\x82\xAC\n");
+    TEST_STRINGIFY_ASCII("\"\\uFFFDa\\uFFFD\\uFFFD\"", "\xFF" "a\xE2\x82");  /* ill-formed */
+    TEST_STRINGIFY_ASCII("\"\\uFFFD\\uFFFD\\uFFFD\"", "\xED\xA0\x80");      /* encoded surrogate */
+}
+
 static void test_stringify_array() {
     TEST_ROUNDTRIP("[]");
     TEST_ROUNDTRIP("[null,false,true,123,\"abc\",[1,2,3]]");
@@ -423,14 +823,106 @@ static void test_stringify_object() {
     TEST_ROUNDTRIP("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+static void test_stringify_into() {
+    zson_value v;
+    char buffer[40];
+    size_t length;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "{\"s\":\"a\\tb\\u0001\",\"a\":[1,true]}"));
+    memset(buffer, '#', sizeof(buffer));
+    EXPECT_EQ_SIZE_T(31, zson_stringify_into(&v, buffer, 31));
+    EXPECT_TRUE(buffer[0] == '#');
+    length = zson_stringify_into(&v, buffer, 32);
+    EXPECT_EQ_STRING("{\"s\":\"a\\tb\\u0001\",\"a\":[1,true]}", buffer, length);
+    zson_free(&v);
+}
+
+static void test_stringify_with_writer() {
+    zson_writer* w = zson_create_writer();
+    zson_value v;
+    const char* json;
+    size_t length, capacity;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "{\"a\":[1,2,\"x\"]}"));
+    json = zson_stringify_with(w, &v, &length, NULL);
+    EXPECT_EQ_STRING("{\"a\":[1,2,\"x\"]}", json, length);
+    capacity = zson_get_writer_capacity(w);
+    json = zson_stringify_with(w, zson_find_object_value(&v, "a", 1), &length, NULL);
+    EXPECT_EQ_STRING("[1,2,\"x\"]", json, length);
+    EXPECT_EQ_SIZE_T(capacity, zson_get_writer_capacity(w));
+    zson_trim_writer(w, 4);
+    EXPECT_EQ_SIZE_T(4, zson_get_writer_capacity(w));
+    json = zson_stringify_with(w, &v, &length, NULL);
+    EXPECT_EQ_STRING("{\"a\":[1,2,\"x\"]}", json, length);
+    zson_free(&v);
+    zson_free_writer(w);
+}
+
+#define TEST_STRINGIFY_PARALLEL(json, nthreads)\
+    do {\
+        zson_value v;\
+        char* json2;\
+        size_t length;\
+        zson_init(&v);\
+        EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, json));\
+        json2 = zson_stringify_parallel(&v, &length, nthreads);\
+        EXPECT_EQ_STRING(json, json2, length);\
+        zson_free(&v);\
+        free(json2);\
+    } while(0)
+
+static void test_stringify_parallel() {
+    static const char big[] = "{\"data\":[[1,{\"a\":\"x\",\"b\":[true,null]},\"\\n\"],2.5,{\"c\":{}},[],\"s\",false,-3,[1,2,3]]}";
+    TEST_STRINGIFY_PARALLEL("null", 4);
+    TEST_STRINGIFY_PARALLEL("[]", 4);
+    TEST_STRINGIFY_PARALLEL("[[[1]]]", 4);
+    TEST_STRINGIFY_PARALLEL("[1,2,3,4,5,6,7]", 3);
+    TEST_STRINGIFY_PARALLEL("{\"a\":1,\"b\":[2],\"c\":{\"d\":3}}", 2);
+    TEST_STRINGIFY_PARALLEL(big, 1);
+    TEST_STRINGIFY_PARALLEL(big, 3);
+    TEST_STRINGIFY_PARALLEL(big, 100);
+}
+
+static void test_stringify_parallel_ex() {
+    zson_stringify_options opt;
+    zson_stats stats;
+    zson_value v;
+    char* json;
+    size_t length;
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "[\"\xE2\x82\xAC\",1,\"a\",[\"\xC2\xA2\"],2,3]"));
+    zson_init_stringify_options(&opt);
+    opt.flags = ZSON_STRINGIFY_ASCII;
+    zson_reset_stats();
+    json = zson_stringify_parallel_ex(&v, &length, 3, &opt);
+    zson_get_stats(&stats);
+    EXPECT_EQ_STRING("[\"\\u20AC\",1,\"a\",[\"\\u00A2\"],2,3]", json, length);
+#ifdef ZSON_STATS
+    EXPECT_EQ_SIZE_T(length, stats.bytes_emitted);
+    EXPECT_EQ_SIZE_T(4, stats.allocs);  /* the output, the chunks and the buffers of the two helpers */
+#else
+    EXPECT_EQ_SIZE_T(0, stats.bytes_emitted);
+    EXPECT_EQ_SIZE_T(0, stats.allocs);
+#endif
+    free(json);
+    zson_free(&v);
+}
+
 static void test_stringify() {
     TEST_ROUNDTRIP("null");
     TEST_ROUNDTRIP("false");
     TEST_ROUNDTRIP("true");
     test_stringify_number();
     test_stringify_string();
+    test_stringify_long_string();
+    test_stringify_escape_growth();
+    test_stringify_ascii();
     test_stringify_array();
     test_stringify_object();
+    test_stringify_into();
+    test_stringify_with_writer();
+    test_stringify_parallel();
+    test_stringify_parallel_ex();
 }
 
 #define TEST_EQUAL(json1, json2, equality) \
@@ -453,6 +945,8 @@ static void test_equal() {
     TEST_EQUAL("null", "0", 0);
     TEST_EQUAL("123", "123", 1);
     TEST_EQUAL("123", "456", 0);
+    TEST_EQUAL("123", "123.0", 1);
+    TEST_EQUAL("9007199254740993", "9007199254740992", 0);
     TEST_EQUAL("\"abc\"", "\"abc\"", 1);
     TEST_EQUAL("\"abc\"", "\"abcd\"", 0);
     TEST_EQUAL("[]", "[]", 1);
@@ -478,10 +972,448 @@ static void test_copy() {
     zson_init(&v2);
     zson_copy(&v2, &v1);
     EXPECT_TRUE(zson_is_equal(&v2, &v1));
+    zson_set_number(zson_get_array_element(zson_find_object_value(&v2, "a", 1), 0), 0.0);
+    EXPECT_EQ_DOUBLE(1.0, zson_get_number(zson_get_array_element(zson_find_object_value(&v1, "a", 1), 0)));
     zson_free(&v1);
     zson_free(&v2);
 }
 
+static void test_copy_on_write() {
+    zson_value v1, v2, v3, scratch;
+    const zson_value* a;
+    size_t length;
+    char* json;
+    zson_init(&v1);
+    zson_parse(&v1, "{\"s\":\"abc\",\"a\":[1,[2,3],{\"k\":4}],\"o\":{\"x\":null}}");
+    zson_init(&v2);
+    zson_copy_shared(&v2, &v1);
+    zson_init(&v3);
+    zson_copy_shared(&v3, &v2);
+
+    /* the const getters read the shared blocks in place */
+    a = zson_find_object_value_const(&v2, "a", 1);
+    EXPECT_TRUE(a == zson_find_object_value_const(&v1, "a", 1));
+    EXPECT_EQ_DOUBLE(2.0, zson_get_number(zson_get_array_element_const(zson_get_array_element_const(a, 1, &scratch), 0, &scratch)));
+    EXPECT_TRUE(zson_get_object_value_const(&v3, 2) == zson_get_object_value_const(&v1, 2));
+    EXPECT_TRUE(zson_find_object_value_const(&v3, "b", 1) == NULL);
+
+    zson_set_number(zson_get_array_element(zson_get_array_element(zson_find_object_value(&v2, "a", 1), 1), 0), 5.0);
+    zson_set_string(zson_set_object_value(zson_find_object_value(&v2, "o", 1), "y", 1), "def", 3);
+    zson_pushback_array_element(zson_find_object_value(&v3, "a", 1));
+    zson_remove_object_value(&v3, 0);
+
+    json = zson_stringify(&v1, &length);
+    EXPECT_EQ_STRING("{\"s\":\"abc\",\"a\":[1,[2,3],{\"k\":4}],\"o\":{\"x\":null}}", json, length);
+    free(json);
+    json = zson_stringify(&v2, &length);
+    EXPECT_EQ_STRING("{\"s\":\"abc\",\"a\":[1,[5,3],{\"k\":4}],\"o\":{\"x\":null,\"y\":\"def\"}}", json, length);
+    free(json);
+    json = zson_stringify(&v3, &length);
+    EXPECT_EQ_STRING("{\"a\":[1,[2,3],{\"k\":4},null],\"o\":{\"x\":null}}", json, length);
+    free(json);
+
+    zson_free(&v1);
+    zson_set_string(zson_find_object_value(&v2, "s", 1), "xyz", 3);
+    EXPECT_EQ_STRING("xyz", zson_get_string(zson_find_object_value(&v2, "s", 1)), 3);
+    zson_free(&v2);
+    EXPECT_EQ_SIZE_T(4, zson_get_array_size(zson_find_object_value(&v3, "a", 1)));
+    zson_free(&v3);
+}
+
+static void test_freeze() {
+    zson_value v1, v2;
+    zson_cell* c;
+    const zson_value* doc;
+    unsigned ticket;
+    size_t length;
+    char* json;
+    zson_init(&v1);
+    zson_parse(&v1, "{\"zz\":[1,{\"b\":2,\"a\":1}],\"b\":true,\"a\":1,\"b\":false,\"ccc\":\"x\"}");
+    zson_init(&v2);
+    zson_copy(&v2, &v1);
+    zson_pushback_array_element(zson_find_object_value(&v1, "zz", 2));
+    zson_freeze(&v1);
+    EXPECT_TRUE(zson_is_frozen(&v1));
+    EXPECT_FALSE(zson_is_frozen(&v2));
+    EXPECT_EQ_SIZE_T(5, zson_get_object_capacity(&v1));
+    EXPECT_EQ_SIZE_T(3, zson_get_array_capacity(zson_find_object_value(&v1, "zz", 2)));
+    EXPECT_EQ_INT(ZSON_TRUE, zson_get_type(zson_find_object_value(&v1, "b", 1)));
+    EXPECT_EQ_SIZE_T(ZSON_KEY_NOT_EXIST, zson_find_object_index(&v1, "c", 1));
+    EXPECT_EQ_SIZE_T(ZSON_KEY_NOT_EXIST, zson_find_object_index(&v1, "zzz", 3));
+    json = zson_stringify(&v1, &length);
+    EXPECT_EQ_STRING("{\"a\":1,\"b\":true,\"b\":false,\"zz\":[1,{\"a\":1,\"b\":2},null],\"ccc\":\"x\"}", json, length);
+    free(json);
+    json = zson_stringify(&v2, &length);
+    EXPECT_EQ_STRING("{\"zz\":[1,{\"b\":2,\"a\":1}],\"b\":true,\"a\":1,\"b\":false,\"ccc\":\"x\"}", json, length);
+    free(json);
+    zson_free(&v2);
+
+    c = zson_create_cell();
+    doc = zson_acquire(c, &ticket);
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(doc));
+    zson_release_acquired(c, ticket);
+    zson_publish(c, &v1);
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v1));
+    doc = zson_acquire(c, &ticket);
+    EXPECT_EQ_SIZE_T(3, zson_find_object_index(doc, "zz", 2));
+    zson_copy(&v2, doc);
+    zson_release_acquired(c, ticket);
+    zson_parse(&v1, "{\"b\":1,\"a\":2}");
+    zson_publish(c, &v1);
+    doc = zson_acquire(c, &ticket);
+    EXPECT_TRUE(zson_is_frozen(doc));
+    EXPECT_EQ_SIZE_T(1, zson_find_object_index(doc, "b", 1));
+    zson_release_acquired(c, ticket);
+    zson_free_cell(c);
+    EXPECT_EQ_STRING("x", zson_get_string(zson_find_object_value(&v2, "ccc", 3)), 1);
+    zson_free(&v2);
+}
+
+static void test_compact() {
+    static const char json[] = "{\"a\":[1,2.5,\"s\",[],{\"k\":[1,2,3]}],\"b\":{\"x\":\"yz\"},\"n\":[0.5,1.5]}";
+    zson_value v1, v2, v3;
+    zson_memory m;
+    size_t length;
+    char* json2;
+    zson_init(&v1);
+    zson_parse(&v1, json);
+    zson_reserve_array(zson_find_object_value(&v1, "a", 1), 16);
+    zson_init(&v2);
+    zson_copy(&v2, &v1);
+    zson_compact(&v1);
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_memory_usage(&v1, &m);
+    EXPECT_EQ_SIZE_T(0, m.unused);
+    EXPECT_EQ_SIZE_T(5, zson_get_array_capacity(zson_find_object_value(&v1, "a", 1)));
+    EXPECT_EQ_SIZE_T(0, zson_get_array_capacity(zson_get_array_element(zson_find_object_value(&v1, "a", 1), 3)));
+    /* depth-first: the members of "b" come after the elements of "a" and its descendants */
+    EXPECT_TRUE((const char*)ZSON_MEMBERS_OF(zson_find_object_value(&v1, "b", 1)) > zson_get_string(zson_get_array_element(zson_find_object_value(&v1, "a", 1), 2)));
+    json2 = zson_stringify(&v1, &length);
+    EXPECT_EQ_STRING(json, json2, length);
+    free(json2);
+
+    /* in-place writes keep the arena, growing and new keys copy out of it */
+    zson_set_number(zson_get_array_element(zson_find_object_value(&v1, "a", 1), 0), 7.0);
+    zson_set_string(zson_find_object_value(zson_find_object_value(&v1, "b", 1), "x", 1), "w", 1);
+    zson_pushback_array_element(zson_find_object_value(&v1, "a", 1));
+    zson_set_object_value(&v1, "c", 1);
+    zson_remove_object_value(zson_find_object_value(&v1, "b", 1), 0);
+    zson_init(&v3);
+    zson_copy(&v3, zson_get_array_element(zson_find_object_value(&v1, "a", 1), 4));
+    json2 = zson_stringify(&v1, &length);
+    EXPECT_EQ_STRING("{\"a\":[7,2.5,\"s\",[],{\"k\":[1,2,3]},null],\"b\":{},\"n\":[0.5,1.5],\"c\":null}", json2, length);
+    free(json2);
+    zson_free(&v1);
+    EXPECT_EQ_SIZE_T(3, zson_get_array_size(zson_find_object_value(&v3, "k", 1)));
+    zson_free(&v3);
+    json2 = zson_stringify(&v2, &length);
+    EXPECT_EQ_STRING(json, json2, length);
+    free(json2);
+
+    zson_freeze(&v2);
+    zson_compact(&v2);
+    EXPECT_TRUE(zson_is_frozen(&v2));
+    EXPECT_EQ_SIZE_T(2, zson_find_object_index(&v2, "n", 1));
+    EXPECT_EQ_DOUBLE(1.5, zson_get_number(zson_get_array_element(zson_find_object_value(&v2, "n", 1), 1)));
+    zson_free(&v2);
+}
+
+static void test_table() {
+    static const char json[] = "[{\"ts\":1,\"host\":\"a\",\"v\":0.5},{\"host\":\"b\",\"ts\":2,\"v\":1.5}]";
+    zson_table* t;
+    zson_value v1, v2;
+    const zson_int64* ts;
+    const double* d;
+    size_t n, length;
+    char* out;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table(&t, json));
+    EXPECT_TRUE(t != NULL);
+    EXPECT_EQ_SIZE_T(2, zson_get_table_rows(t));
+    EXPECT_EQ_SIZE_T(3, zson_get_table_columns(t));
+    EXPECT_EQ_STRING("host", zson_get_column_key(t, 1), zson_get_column_key_length(t, 1));
+    EXPECT_EQ_SIZE_T(ZSON_KEY_NOT_EXIST, zson_find_column(t, "x", 1));
+    EXPECT_TRUE(zson_get_int64_array(zson_get_column(t, zson_find_column(t, "ts", 2)), &ts, &n));
+    EXPECT_TRUE(n == 2 && ts[0] == 1 && ts[1] == 2);
+    EXPECT_TRUE(zson_get_number_array(zson_get_column(t, 2), &d, &n));
+    EXPECT_EQ_DOUBLE(2.0, d[0] + d[1]);
+    EXPECT_FALSE(zson_get_number_array(zson_get_column(t, 1), &d, &n));
+    out = zson_stringify_table(t, &length);
+    EXPECT_EQ_STRING("[{\"ts\":1,\"host\":\"a\",\"v\":0.5},{\"ts\":2,\"host\":\"b\",\"v\":1.5}]", out, length);
+    free(out);
+    zson_init(&v1);
+    zson_init(&v2);
+    zson_table_to_value(&v1, t);
+    zson_parse(&v2, json);
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_free_table(t);
+    zson_free(&v1);
+    zson_free(&v2);
+
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table(&t, "[]"));
+    EXPECT_EQ_SIZE_T(0, zson_get_table_rows(t));
+    out = zson_stringify_table(t, &length);
+    EXPECT_EQ_STRING("[]", out, length);
+    free(out);
+    zson_free_table(t);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table(&t, "[{\"a\":1},{\"b\":1}]"));
+    EXPECT_TRUE(t == NULL);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table(&t, "[{\"a\":1,\"a\":2},{\"a\":1,\"b\":1}]"));
+    EXPECT_TRUE(t == NULL);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table(&t, "{\"a\":1}"));
+    EXPECT_TRUE(t == NULL);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse_table(&t, "[{}"));
+    EXPECT_TRUE(t == NULL);
+}
+
+#define TEST_TAPE_ERROR(error, json)\
+    do {\
+        zson_tape* t;\
+        EXPECT_EQ_INT(error, zson_parse_tape(&t, json));\
+        EXPECT_TRUE(t == NULL);\
+    } while(0)
+
+static void test_tape() {
+    static const char json[] = " {\"n\":null,\"t\":true,\"i\":-9223372036854775808,\"d\":2.5,"
+        "\"s\":\"a\\u0000b\",\"a\":[[],{},[1,\"x\"],18446744073709551615],\"o\":{\"k\":false}} ";
+    zson_tape* t;
+    zson_cursor c, e;
+    zson_value v1, v2;
+    const double* d;
+    const char* str;
+    size_t length;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_tape(&t, json));
+    zson_get_tape_root(t, &c);
+    EXPECT_EQ_INT(ZSON_OBJECT, zson_get_cursor_type(&c));
+    EXPECT_EQ_SIZE_T(7, zson_get_cursor_size(&c));
+    EXPECT_TRUE(zson_cursor_first(&c));
+    str = zson_get_cursor_key(&c, &length);
+    EXPECT_EQ_STRING("n", str, length);
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_cursor_type(&c));
+    EXPECT_TRUE(zson_cursor_next(&c));
+    EXPECT_EQ_INT(ZSON_TRUE, zson_get_cursor_type(&c));
+    EXPECT_TRUE(zson_cursor_next(&c));
+    EXPECT_TRUE(zson_get_cursor_int64(&c) == -9223372036854775807 - 1);
+    EXPECT_TRUE(zson_cursor_next(&c));
+    EXPECT_EQ_DOUBLE(2.5, zson_get_cursor_number(&c));
+    EXPECT_TRUE(zson_cursor_next(&c));
+    str = zson_get_cursor_string(&c, &length);
+    EXPECT_EQ_STRING("a\0b", str, length);
+    EXPECT_TRUE(zson_cursor_next(&c));
+    EXPECT_EQ_INT(ZSON_ARRAY, zson_get_cursor_type(&c));
+    e = c;
+    EXPECT_TRUE(zson_cursor_first(&e));
+    EXPECT_FALSE(zson_cursor_first(&e));
+    EXPECT_EQ_SIZE_T(0, zson_get_cursor_size(&e));
+    EXPECT_TRUE(zson_cursor_next(&e));
+    EXPECT_EQ_INT(ZSON_OBJECT, zson_get_cursor_type(&e));
+    EXPECT_FALSE(zson_cursor_find(&e, "k", 1));
+    EXPECT_TRUE(zson_cursor_next(&e));
+    EXPECT_EQ_SIZE_T(2, zson_get_cursor_size(&e));
+    EXPECT_TRUE(zson_cursor_next(&e));
+    EXPECT_EQ_DOUBLE(18446744073709551615.0, zson_get_cursor_number(&e));
+    EXPECT_FALSE(zson_cursor_next(&e));
+    EXPECT_TRUE(zson_cursor_next(&c));
+    EXPECT_FALSE(zson_cursor_next(&c));
+    str = zson_get_cursor_key(&c, &length);
+    EXPECT_EQ_STRING("o", str, length);
+
+    zson_get_tape_root(t, &c);
+    EXPECT_TRUE(zson_cursor_find(&c, "o", 1));
+    EXPECT_TRUE(zson_cursor_find(&c, "k", 1));
+    EXPECT_EQ_INT(ZSON_FALSE, zson_get_cursor_type(&c));
+    zson_get_tape_root(t, &c);
+    EXPECT_FALSE(zson_cursor_find(&c, "x", 1));
+    EXPECT_EQ_INT(ZSON_OBJECT, zson_get_cursor_type(&c));
+
+    zson_init(&v1);
+    zson_init(&v2);
+    zson_cursor_to_value(&v1, &c);
+    zson_parse(&v2, json);
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_free(&v2);
+    EXPECT_TRUE(zson_cursor_find(&c, "a", 1));
+    zson_cursor_to_value(&v1, &c);
+    zson_parse(&v2, "[[],{},[1,\"x\"],18446744073709551615]");
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_free(&v1);
+    zson_free(&v2);
+    zson_free_tape(t);
+
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_tape(&t, "[1.5,2.5]"));
+    zson_get_tape_root(t, &c);
+    zson_init(&v1);
+    zson_cursor_to_value(&v1, &c);
+    EXPECT_FALSE(zson_get_number_array(&v1, &d, &length));
+    EXPECT_EQ_DOUBLE(2.5, zson_get_number(zson_get_array_element(&v1, 1)));
+    zson_free(&v1);
+    zson_free_tape(t);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_tape(&t, "\"\""));
+    zson_get_tape_root(t, &c);
+    str = zson_get_cursor_string(&c, &length);
+    EXPECT_EQ_STRING("", str, length);
+    zson_free_tape(t);
+
+    TEST_TAPE_ERROR(ZSON_PARSE_EXPECT_VALUE, " ");
+    TEST_TAPE_ERROR(ZSON_PARSE_INVALID_VALUE, "[1,]");
+    TEST_TAPE_ERROR(ZSON_PARSE_ROOT_NOT_SINGULAR, "[] x");
+    TEST_TAPE_ERROR(ZSON_PARSE_MISS_QUOTATION_MARK, "[\"abc");
+    TEST_TAPE_ERROR(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[[1}");
+    TEST_TAPE_ERROR(ZSON_PARSE_MISS_KEY, "{1:1}");
+    TEST_TAPE_ERROR(ZSON_PARSE_MISS_COLON, "{\"a\" 1}");
+    TEST_TAPE_ERROR(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
+}
+
+#define TEST_READER_ERROR(error, json)\
+    do {\
+        zson_reader* r = zson_create_reader(json);\
+        while (zson_reader_next(r) > ZSON_TOKEN_ERROR)\
+            ;\
+        EXPECT_EQ_INT(error, zson_get_reader_error(r));\
+        EXPECT_EQ_INT(ZSON_TOKEN_ERROR, zson_reader_next(r));\
+        zson_free_reader(r);\
+    } while(0)
+
+static void test_reader() {
+    static const char path[] = "zson_test_reader.json";
+    zson_reader* r;
+    zson_value v1, v2;
+    const char* str;
+    char name[32];
+    size_t i, length;
+    FILE* fp;
+    r = zson_create_reader(" {\"a\":[1,\"x\\ty\",[]],\"b\":{\"c\":[true,{}]},\"d\":null,\"e\":{\"f\":-5}} ");
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    str = zson_get_reader_string(r, &length);
+    EXPECT_EQ_STRING("a", str, length);
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_NUMBER, zson_reader_next(r));
+    EXPECT_EQ_DOUBLE(1.0, zson_get_reader_number(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_STRING, zson_reader_next(r));
+    str = zson_get_reader_string(r, &length);
+    EXPECT_EQ_STRING("x\ty", str, length);
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_skip(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    zson_init(&v1);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v1));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_OBJECT, zson_get_type(&v1));
+    EXPECT_TRUE(zson_get_int64(zson_find_object_value(&v1, "f", 1)) == -5);
+    EXPECT_EQ_INT(ZSON_TOKEN_END_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END, zson_reader_next(r));
+    zson_free_reader(r);
+    zson_free(&v1);
+
+    TEST_READER_ERROR(ZSON_PARSE_EXPECT_VALUE, " ");
+    TEST_READER_ERROR(ZSON_PARSE_INVALID_VALUE, "[1,]");
+    TEST_READER_ERROR(ZSON_PARSE_ROOT_NOT_SINGULAR, "[] x");
+    TEST_READER_ERROR(ZSON_PARSE_MISS_QUOTATION_MARK, "[\"abc");
+    TEST_READER_ERROR(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, "[[1}");
+    TEST_READER_ERROR(ZSON_PARSE_MISS_KEY, "{1:1}");
+    TEST_READER_ERROR(ZSON_PARSE_MISS_COLON, "{\"a\" 1}");
+    TEST_READER_ERROR(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"a\":1");
+    r = zson_create_reader("[[1,\"]\"}]");
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_reader_skip(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_ERROR, zson_reader_next(r));
+    zson_free_reader(r);
+    r = zson_create_reader("[1,{\"a\":x}]");
+    zson_init(&v1);
+    zson_reader_next(r);
+    EXPECT_EQ_INT(ZSON_PARSE_INVALID_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v1));
+    zson_free_reader(r);
+    r = zson_create_reader("[1,[]]");
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_NUMBER, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_TOKEN_END, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_NULL, zson_get_type(&v1));
+    zson_free_reader(r);
+    r = zson_create_reader("{\"a\":{}}");
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_EXPECT_VALUE, zson_reader_read_value(r, &v1));
+    EXPECT_EQ_INT(ZSON_TOKEN_END_OBJECT, zson_reader_next(r));
+    zson_free_reader(r);
+    r = zson_create_reader("[1,]");
+    zson_reader_next(r);
+    zson_reader_next(r);
+    EXPECT_EQ_INT(ZSON_TOKEN_ERROR, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_INVALID_VALUE, zson_reader_read_value(r, &v1));
+    zson_free_reader(r);
+
+    /* tokens and escapes cut by the read chunks, and a string longer than one */
+    EXPECT_TRUE(zson_open_reader("zson_test_no_such_file.json") == NULL);
+    fp = fopen(path, "wb");
+    fputs("{\"items\":[", fp);
+    for (i = 0; i < 5000; i++)
+        fprintf(fp, "%s{\"id\":%u,\"name\":\"item\\n\\u00e9 %u\",\"tags\":[true,false,null,1.5e3]}",
+            i > 0 ? ", " : "", (unsigned)i, (unsigned)i);
+    fputs("],\"long\":\"", fp);
+    for (i = 0; i < 100000; i++)
+        fputc('a' + (int)(i % 26), fp);
+    fputs("\"}", fp);
+    fclose(fp);
+    r = zson_open_reader(path);
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    /* every other record is skipped, a few of the read ones are checked, a failure stops the count */
+    for (i = 0; zson_reader_next(r) == ZSON_TOKEN_START_OBJECT; i++) {
+        if (i % 2 == 0) {
+            if (zson_reader_skip(r) != ZSON_PARSE_OK)
+                break;
+            continue;
+        }
+        if (zson_reader_read_value(r, &v1) != ZSON_PARSE_OK)
+            break;
+        if (i == 1 || i == 2499 || i == 4999) {
+            sprintf(name, "item\n\xC3\xA9 %u", (unsigned)i);
+            EXPECT_TRUE(zson_get_int64(zson_find_object_value(&v1, "id", 2)) == (zson_int64)i);
+            EXPECT_EQ_SIZE_T(strlen(name), zson_get_string_length(zson_find_object_value(&v1, "name", 4)));
+            EXPECT_TRUE(strcmp(name, zson_get_string(zson_find_object_value(&v1, "name", 4))) == 0);
+            EXPECT_EQ_SIZE_T(4, zson_get_array_size(zson_find_object_value(&v1, "tags", 4)));
+        }
+    }
+    EXPECT_EQ_SIZE_T(5000, i);
+    EXPECT_EQ_INT(ZSON_TOKEN_KEY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_STRING, zson_reader_next(r));
+    zson_get_reader_string(r, &length);
+    EXPECT_EQ_SIZE_T(100000, length);
+    EXPECT_EQ_INT(ZSON_TOKEN_END_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_END, zson_reader_next(r));
+    zson_free_reader(r);
+
+    r = zson_open_reader(path);
+    zson_reader_next(r);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_read_value(r, &v1));
+    zson_init(&v2);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file(&v2, path, 0));
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_free_reader(r);
+    zson_free(&v1);
+    zson_free(&v2);
+    remove(path);
+}
+
 static void test_move() {
     zson_value v1, v2, v3;
     zson_init(&v1);
@@ -510,6 +1442,391 @@ static void test_swap() {
     zson_free(&v2);
 }
 
+static void test_deep_nesting() {
+    const size_t depth = 100000;
+    zson_parse_options opt;
+    zson_value v1, v2;
+    char* json, *json2;
+    size_t i, length;
+    json = (char*)malloc(depth * 6 + 2);
+    for (i = 0; i < depth; i++)
+        memcpy(json + i * 5, "{\"a\":", 5);
+    json[depth * 5] = '1';
+    memset(json + depth * 5 + 1, '}', depth);
+    json[depth * 6 + 1] = '\0';
+    zson_init_parse_options(&opt);
+    opt.max_depth = depth;
+    zson_init(&v1);
+    zson_init(&v2);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v1, json, &opt));
+    json2 = zson_stringify(&v1, &length);
+    EXPECT_EQ_SIZE_T(depth * 6 + 1, length);
+    EXPECT_TRUE(memcmp(json, json2, length) == 0);
+    zson_copy(&v2, &v1);
+    EXPECT_TRUE(zson_is_equal(&v1, &v2));
+    zson_set_number(zson_find_object_value(zson_find_object_value(&v2, "a", 1), "a", 1), 0);
+    EXPECT_FALSE(zson_is_equal(&v1, &v2));
+    zson_free(&v1);
+    zson_free(&v2);
+    free(json);
+    free(json2);
+}
+
+typedef struct {
+    size_t allocs;  /* allocate() and reallocate() of NULL */
+    size_t frees;   /* deallocate() of a block */
+}counting_allocator;
+
+/* the parallel entry points call the hooks from several threads */
+#if defined(__GNUC__)
+#define COUNT(n) __sync_add_and_fetch(&(n), 1)
+#else
+#define COUNT(n) ((n)++)
+#endif
+
+static void* counting_allocate(void* ctx, size_t size) {
+    COUNT(((counting_allocator*)ctx)->allocs);
+    return malloc(size);
+}
+
+static void* counting_reallocate(void* ctx, void* ptr, size_t size) {
+    if (ptr == NULL)
+        COUNT(((counting_allocator*)ctx)->allocs);
+    return realloc(ptr, size);
+}
+
+static void counting_deallocate(void* ctx, void* ptr) {
+    if (ptr != NULL)
+        COUNT(((counting_allocator*)ctx)->frees);
+    free(ptr);
+}
+
+static void test_allocator() {
+    static const char path[] = "zson_test_allocator.json";
+    counting_allocator count = { 0, 0 };
+    zson_allocator a = { counting_allocate, counting_reallocate, counting_deallocate, NULL };
+    counting_allocator strays = { 0, 0 };
+    zson_allocator global = { counting_allocate, counting_reallocate, counting_deallocate, NULL };
+    zson_parse_options popt;
+    zson_stringify_options sopt;
+    zson_parser* p;
+    zson_writer* w;
+    zson_table* t;
+    zson_tape* tape;
+    zson_cursor c;
+    zson_reader* r;
+    zson_value v, v2;
+    FILE* fp;
+    char* json;
+    size_t length;
+    a.ctx = &count;
+    global.ctx = &strays;
+    zson_init(&v);
+    zson_init(&v2);
+
+    /* per call: the value and the returned string */
+    zson_init_parse_options(&popt);
+    popt.allocator = &a;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "{\"a\":[1,\"x\",{\"b\":null}],\"s\":\"str\"}", &popt));
+    EXPECT_TRUE(count.allocs > 0);
+    zson_init_stringify_options(&sopt);
+    sopt.allocator = &a;
+    json = zson_stringify_ex(&v, &length, &sopt);
+    EXPECT_EQ_STRING("{\"a\":[1,\"x\",{\"b\":null}],\"s\":\"str\"}", json, length);
+    counting_deallocate(&count, json);
+    zson_free(&v);
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, zson_parse_ex(&v, "{\"a\":[\"x\",{\"b\":\"y\"}] 1}", &popt));
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+
+    /* the other entry points take options too, nothing of theirs comes from the global allocator */
+    zson_set_allocator(&global);
+    count.allocs = count.frees = 0;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_parallel_ex(&v, "[1,\"x\",{\"b\":[2]},\"y\",[]]", 3, &popt));
+    zson_copy(&v2, &v);
+    zson_compact(&v2);
+    EXPECT_TRUE(zson_is_equal(&v, &v2));
+    json = zson_stringify_parallel_ex(&v2, &length, 3, &sopt);
+    EXPECT_EQ_STRING("[1,\"x\",{\"b\":[2]},\"y\",[]]", json, length);
+    counting_deallocate(&count, json);
+    zson_free(&v2);
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse_parallel_ex(&v, "[\"x\",{\"b\":2} 1,2]", 3, &popt));
+    fp = fopen(path, "wb");
+    fputs("[{\"a\":1,\"b\":\"x\"},{\"b\":\"y\",\"a\":2}]", fp);
+    fclose(fp);
+    popt.flags = ZSON_PARSE_FILE_READ;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_file_ex(&v, path, &popt));
+    popt.flags = 0;
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_table_ex(&t, "[{\"a\":1,\"b\":\"x\"},{\"b\":\"y\",\"a\":2}]", &popt));
+    zson_table_to_value(&v, t);
+    zson_free_table(t);
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_tape_ex(&tape, "{\"a\":[1,\"x\"]}", &popt));
+    zson_get_tape_root(tape, &c);
+    zson_cursor_to_value(&v, &c);
+    zson_free_tape(tape);
+    zson_free(&v);
+    r = zson_create_reader_ex("{\"a\":[1,\"x\",{}]}", &popt);
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_read_value(r, &v));
+    zson_free_reader(r);
+    zson_free(&v);
+    r = zson_open_reader_ex(path, &popt);
+    EXPECT_EQ_INT(ZSON_TOKEN_START_ARRAY, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_TOKEN_START_OBJECT, zson_reader_next(r));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_reader_read_value(r, &v));
+    zson_free_reader(r);
+    zson_free(&v);
+    remove(path);
+    zson_set_allocator(NULL);
+    EXPECT_TRUE(count.allocs > 0);
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+    EXPECT_EQ_SIZE_T(0, strays.allocs);
+
+    /* mutations and zson_free() use the allocator each block came from */
+    count.allocs = count.frees = 0;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[\"a\",\"b\",{\"k\":1}]", &popt));
+    zson_set_string(zson_pushback_array_element(&v), "c", 1);
+    zson_set_object_value(zson_get_array_element(&v, 2), "k2", 2);
+    zson_remove_object_value(zson_get_array_element(&v, 2), 0);
+    zson_shrink_array(&v);
+    json = zson_stringify(&v, &length);
+    EXPECT_EQ_STRING("[\"a\",\"b\",{\"k2\":null},\"c\"]", json, length);
+    free(json);
+    zson_free(&v);
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+
+    /* global: tree mutations, handles and projections */
+    zson_set_allocator(&a);
+    count.allocs = count.frees = 0;
+    p = zson_create_parser();
+    w = zson_create_writer();
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_with(p, &v, "[1,{\"k\":\"v\"}]", NULL));
+    zson_set_string(zson_pushback_array_element(&v), "abc", 3);
+    zson_set_object_value(zson_get_array_element(&v, 1), "k2", 2);
+    json = (char*)zson_stringify_with(w, &v, &length, NULL);
+    EXPECT_EQ_STRING("[1,{\"k\":\"v\",\"k2\":null},\"abc\"]", json, length);
+    zson_free(&v);
+    zson_free_parser(p);
+    zson_free_writer(w);
+    zson_free_projection(zson_create_projection(NULL, 0));
+    EXPECT_TRUE(count.allocs > 0);
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+    zson_set_allocator(NULL);
+}
+
+static void test_memory_usage() {
+    zson_value v;
+    zson_memory m;
+    zson_stats stats;
+    zson_init(&v);
+    EXPECT_EQ_SIZE_T(0, zson_memory_usage(&v, NULL));
+    zson_reset_stats();
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "{\"a\":[1,2],\"bc\":\"xyz\"}"));
+    EXPECT_EQ_SIZE_T(2 * sizeof(zson_member) + 2 * sizeof(zson_value) + 5 + 4, zson_memory_usage(&v, &m));
+    EXPECT_EQ_SIZE_T(2 * sizeof(zson_member) + 2 * sizeof(zson_value), m.nodes);
+    EXPECT_EQ_SIZE_T(5, m.keys);
+    EXPECT_EQ_SIZE_T(4, m.strings);
+    EXPECT_EQ_SIZE_T(0, m.unused);
+    zson_pushback_array_element(zson_find_object_value(&v, "a", 1));
+    zson_memory_usage(&v, &m);
+    EXPECT_EQ_SIZE_T(2 * sizeof(zson_member) + 3 * sizeof(zson_value), m.nodes);
+    EXPECT_EQ_SIZE_T(sizeof(zson_value), m.unused);
+    zson_get_stats(&stats);
+#ifdef ZSON_STATS
+    EXPECT_EQ_SIZE_T(22, stats.bytes_parsed);
+    EXPECT_EQ_SIZE_T(0, stats.bytes_emitted);
+    EXPECT_EQ_SIZE_T(6, stats.allocs);  /* the stack, the members, two keys, the elements and "xyz" */
+    EXPECT_EQ_SIZE_T(1, stats.reallocs);
+    EXPECT_EQ_SIZE_T(1, stats.stack_growths);
+#else
+    EXPECT_EQ_SIZE_T(0, stats.bytes_parsed);
+    EXPECT_EQ_SIZE_T(0, stats.bytes_emitted);
+    EXPECT_EQ_SIZE_T(0, stats.allocs);
+    EXPECT_EQ_SIZE_T(0, stats.reallocs);
+    EXPECT_EQ_SIZE_T(0, stats.stack_growths);
+#endif
+    zson_free(&v);
+}
+
+/* open events of the hooks, each end() must close the innermost one */
+typedef struct {
+    zson_trace_kind open[16];
+    size_t depth, begins, ends, mismatches;
+}trace_calls;
+
+static void trace_begin(void* ctx, zson_trace_kind kind) {
+    trace_calls* calls = (trace_calls*)ctx;
+    if (calls->depth < sizeof(calls->open) / sizeof(calls->open[0]))
+        calls->open[calls->depth] = kind;
+    calls->depth++;
+    calls->begins++;
+}
+
+static void trace_end(void* ctx, zson_trace_kind kind, size_t bytes) {
+    trace_calls* calls = (trace_calls*)ctx;
+    (void)bytes;
+    if (calls->depth == 0 || (calls->depth <= sizeof(calls->open) / sizeof(calls->open[0]) && calls->open[calls->depth - 1] != kind))
+        calls->mismatches++;
+    else
+        calls->depth--;
+    calls->ends++;
+}
+
+static void test_trace() {
+    trace_calls calls;
+    zson_trace_hooks hooks = { trace_begin, trace_end, NULL };
+    zson_trace trace;
+    zson_value v;
+    char* json;
+    size_t length;
+    memset(&calls, 0, sizeof(calls));
+    hooks.ctx = &calls;
+    zson_set_trace_hooks(&hooks);
+    zson_reset_trace();
+    zson_init(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "{\"a\\n\":[1,\"x\"]}"));
+    json = zson_stringify(&v, &length);
+    zson_get_trace(&trace);
+#ifdef ZSON_TRACE
+    EXPECT_EQ_SIZE_T(2, trace.count[ZSON_TRACE_PARSE_STRING]);
+    EXPECT_EQ_SIZE_T(8, trace.bytes[ZSON_TRACE_PARSE_STRING]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_PARSE_NUMBER]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_PARSE_ARRAY]);
+    EXPECT_EQ_SIZE_T(7, trace.bytes[ZSON_TRACE_PARSE_ARRAY]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_PARSE_OBJECT]);
+    EXPECT_EQ_SIZE_T(15, trace.bytes[ZSON_TRACE_PARSE_OBJECT]);
+    EXPECT_EQ_SIZE_T(2, trace.count[ZSON_TRACE_STRINGIFY_STRING]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_STRINGIFY_NUMBER]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_STRINGIFY_ARRAY]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_STRINGIFY_OBJECT]);
+    EXPECT_EQ_SIZE_T(length, trace.bytes[ZSON_TRACE_STRINGIFY_OBJECT]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_STACK_GROWTH]);
+    EXPECT_EQ_SIZE_T(1, trace.escapes_parsed);
+    EXPECT_EQ_SIZE_T(1, trace.escapes_emitted);
+    EXPECT_EQ_SIZE_T(11, calls.begins);  /* one per event counted above */
+#else
+    EXPECT_EQ_SIZE_T(0, trace.count[ZSON_TRACE_PARSE_STRING]);
+    EXPECT_EQ_SIZE_T(0, trace.bytes[ZSON_TRACE_PARSE_OBJECT]);
+    EXPECT_EQ_SIZE_T(0, trace.bytes[ZSON_TRACE_STRINGIFY_OBJECT]);
+    EXPECT_EQ_SIZE_T(0, trace.escapes_parsed);
+    EXPECT_EQ_SIZE_T(0, trace.escapes_emitted);
+    EXPECT_EQ_SIZE_T(0, calls.begins);
+#endif
+    EXPECT_EQ_SIZE_T(calls.begins, calls.ends);
+    EXPECT_EQ_SIZE_T(0, calls.mismatches);
+    zson_free(&v);
+
+    /* the containers left open by an error end too, innermost first */
+    zson_reset_trace();
+    memset(&calls, 0, sizeof(calls));
+    EXPECT_EQ_INT(ZSON_PARSE_MISS_COMMA_OR_SQUARE_BRACKET, zson_parse(&v, "[[1,\"a\"} 2]"));
+    zson_get_trace(&trace);
+#ifdef ZSON_TRACE
+    EXPECT_EQ_SIZE_T(2, trace.count[ZSON_TRACE_PARSE_ARRAY]);
+    EXPECT_EQ_SIZE_T(1, trace.count[ZSON_TRACE_PARSE_STRING]);
+    EXPECT_EQ_SIZE_T(5, calls.begins);
+#else
+    EXPECT_EQ_SIZE_T(0, trace.count[ZSON_TRACE_PARSE_ARRAY]);
+    EXPECT_EQ_SIZE_T(0, calls.begins);
+#endif
+    EXPECT_EQ_SIZE_T(calls.begins, calls.ends);
+    EXPECT_EQ_SIZE_T(0, calls.depth);
+    EXPECT_EQ_SIZE_T(0, calls.mismatches);
+    zson_set_trace_hooks(NULL);
+    free(json);
+}
+
+typedef struct {
+    double x, y;
+}test_point;
+
+typedef struct {
+    zson_int64 id;
+    int ok, count;
+    char* name;
+    test_point pos;
+}test_message;
+
+static const zson_field test_point_fields[] = {
+    { "x", ZSON_FIELD_DOUBLE, offsetof(test_point, x), NULL },
+    { "y", ZSON_FIELD_DOUBLE, offsetof(test_point, y), NULL },
+    { NULL, ZSON_FIELD_DOUBLE, 0, NULL }
+};
+
+static const zson_field test_message_fields[] = {
+    { "id",    ZSON_FIELD_INT64,   offsetof(test_message, id),    NULL },
+    { "ok",    ZSON_FIELD_BOOLEAN, offsetof(test_message, ok),    NULL },
+    { "count", ZSON_FIELD_INT,     offsetof(test_message, count), NULL },
+    { "name",  ZSON_FIELD_STRING,  offsetof(test_message, name),  NULL },
+    { "pos",   ZSON_FIELD_OBJECT,  offsetof(test_message, pos),   test_point_fields },
+    { NULL, ZSON_FIELD_INT, 0, NULL }
+};
+
+#define TEST_STRUCT_ERROR(error, json)\
+    do {\
+        test_message m;\
+        memset(&m, 0, sizeof(m));\
+        EXPECT_EQ_INT(error, zson_parse_struct(&m, test_message_fields, json));\
+        zson_free_struct(&m, test_message_fields);\
+    } while(0)
+
+static void test_struct() {
+    counting_allocator count = { 0, 0 };
+    zson_allocator a = { counting_allocate, counting_reallocate, counting_deallocate, NULL };
+    zson_parse_options popt;
+    zson_stringify_options sopt;
+    test_message m;
+    char* json;
+    size_t length;
+    memset(&m, 0, sizeof(m));
+    m.count = 7;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_struct(&m, test_message_fields,
+        " { \"pos\" : {\"y\":-2.5,\"x\":1e2}, \"id\":9007199254740993, \"skip\":[{\"id\":1}], \"ok\":true, \"name\":\"a\\u00e9\" } "));
+    EXPECT_TRUE(m.id == (zson_int64)9007199254740992.0 + 1);
+    EXPECT_EQ_INT(1, m.ok);
+    EXPECT_EQ_INT(7, m.count);
+    EXPECT_EQ_STRING("a\xC3\xA9", m.name, strlen(m.name));
+    EXPECT_EQ_DOUBLE(100.0, m.pos.x);
+    EXPECT_EQ_DOUBLE(-2.5, m.pos.y);
+    json = zson_stringify_struct(&m, test_message_fields, &length);
+    EXPECT_EQ_STRING("{\"id\":9007199254740993,\"ok\":true,\"count\":7,\"name\":\"a\xC3\xA9\",\"pos\":{\"x\":100,\"y\":-2.5}}", json, length);
+    free(json);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_struct(&m, test_message_fields, "{\"name\":null,\"count\":-3.0}"));
+    EXPECT_TRUE(m.name == NULL);
+    EXPECT_EQ_INT(-3, m.count);
+    zson_free_struct(&m, test_message_fields);
+
+    /* strings from the allocator of the options, freed with the same options */
+    a.ctx = &count;
+    zson_init_parse_options(&popt);
+    popt.allocator = &a;
+    zson_init_stringify_options(&sopt);
+    sopt.allocator = &a;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_struct_ex(&m, test_message_fields, "{\"name\":\"x\"}", &popt));
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_struct_ex(&m, test_message_fields, "{\"name\":\"yz\"}", &popt));
+    json = zson_stringify_struct_ex(&m, test_message_fields, &length, &sopt);
+    EXPECT_EQ_STRING("{\"id\":9007199254740993,\"ok\":true,\"count\":-3,\"name\":\"yz\",\"pos\":{\"x\":100,\"y\":-2.5}}", json, length);
+    counting_deallocate(&count, json);
+    zson_free_struct_ex(&m, test_message_fields, &popt);
+    EXPECT_TRUE(m.name == NULL);
+    EXPECT_TRUE(count.allocs >= 3);
+    EXPECT_EQ_SIZE_T(count.allocs, count.frees);
+
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "[]");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"ok\":1}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"count\":1.5}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"count\":3000000000}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"id\":9223372036854775808}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"name\":\"x\",\"pos\":[]}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_SCHEMA_MISMATCH, "{\"name\":1}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_MISS_COMMA_OR_CURLY_BRACKET, "{\"name\":\"x\" \"id\":1}");
+    TEST_STRUCT_ERROR(ZSON_PARSE_ROOT_NOT_SINGULAR, "{} x");
+    TEST_STRUCT_ERROR(ZSON_PARSE_EXPECT_VALUE, "");
+}
+
 static void test_access_null() {
     zson_value v;
     zson_init(&v);
@@ -539,6 +1856,50 @@ static void test_access_number() {
     zson_free(&v);
 }
 
+/* Infinities and NaNs stay numbers, also the NaNs that ZSON_SMALL_VALUES uses to box the other types. */
+static void test_access_special_number() {
+    zson_value v;
+    double zero = 0.0, d;
+    zson_uint64 bits = (zson_uint64)0x7FFE << 48 | 0x1234;
+    memcpy(&d, &bits, sizeof(double));
+    zson_init(&v);
+    zson_set_number(&v, 1.0 / zero);
+    EXPECT_EQ_INT(ZSON_NUMBER, zson_get_type(&v));
+    EXPECT_TRUE(zson_get_number(&v) > 1e308);
+    zson_set_number(&v, -1.0 / zero);
+    EXPECT_EQ_INT(ZSON_NUMBER, zson_get_type(&v));
+    EXPECT_TRUE(zson_get_number(&v) < -1e308);
+    zson_set_number(&v, zero / zero);
+    EXPECT_EQ_INT(ZSON_NUMBER, zson_get_type(&v));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_number(&v) != zson_get_number(&v));
+    zson_set_number(&v, d);
+    EXPECT_EQ_INT(ZSON_NUMBER, zson_get_type(&v));
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_number(&v) != zson_get_number(&v));
+    zson_free(&v);
+#ifdef ZSON_SMALL_VALUES
+    EXPECT_TRUE(sizeof(zson_value) <= 16);
+#endif
+}
+
+static void test_access_integer() {
+    zson_value v;
+    zson_init(&v);
+    zson_set_string(&v, "a", 1);
+    zson_set_int64(&v, -42);
+    EXPECT_TRUE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_int64(&v) == -42);
+    EXPECT_EQ_DOUBLE(-42.0, zson_get_number(&v));
+    EXPECT_TRUE(zson_get_uint64(&v) == 0);
+    zson_set_uint64(&v, 7);
+    EXPECT_TRUE(zson_get_int64(&v) == 7);
+    zson_set_number(&v, 1e30);
+    EXPECT_FALSE(zson_is_integer(&v));
+    EXPECT_TRUE(zson_get_uint64(&v) == (zson_uint64)-1);
+    zson_free(&v);
+}
+
 static void test_access_string() {
     zson_value v;
     zson_init(&v);
@@ -625,8 +1986,58 @@ static void test_access_array() {
     zson_free(&a);
 }
 
+static void test_access_packed_array() {
+    zson_parse_options opt;
+    zson_value v, w, scratch;
+    const double* d;
+    const zson_int64* i;
+    size_t n, length;
+    char* json;
+    zson_init(&v);
+    zson_init(&w);
+    zson_init_parse_options(&opt);
+    opt.flags = ZSON_PARSE_PACK_ARRAYS;
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse(&v, "[1.5,-2e3,0.25]"));
+    EXPECT_FALSE(zson_get_number_array(&v, &d, &n));  /* only packed on request */
+    EXPECT_EQ_DOUBLE(0.25, zson_get_number(zson_get_array_element(&v, 2)));
+    zson_free(&v);
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[1.5,-2e3,0.25]", &opt));
+    EXPECT_TRUE(zson_get_number_array(&v, &d, &n));
+    EXPECT_FALSE(zson_get_int64_array(&v, &i, &n));
+    EXPECT_EQ_SIZE_T(3, n);
+    EXPECT_EQ_DOUBLE(-2e3, d[1]);
+    EXPECT_EQ_DOUBLE(0.25, zson_get_number(zson_get_array_element_const(&v, 2, &scratch)));
+    EXPECT_TRUE(zson_get_number_array(&v, &d, &n));  /* still packed after a const read */
+    zson_copy(&w, &v);
+    json = zson_stringify(&v, &length);
+    EXPECT_EQ_STRING("[1.5,-2000,0.25]", json, length);
+    free(json);
+    EXPECT_EQ_DOUBLE(0.25, zson_get_number(zson_get_array_element(&v, 2)));
+    EXPECT_FALSE(zson_get_number_array(&v, &d, &n));
+    EXPECT_TRUE(zson_is_equal(&v, &w));
+    EXPECT_TRUE(zson_get_number_array(&w, &d, &n));
+    EXPECT_TRUE(zson_pack_array(&v));
+    EXPECT_TRUE(zson_get_number_array(&v, &d, &n));
+    zson_free(&v);
+
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[1,-2,9223372036854775807]", &opt));
+    EXPECT_TRUE(zson_get_int64_array(&v, &i, &n));
+    EXPECT_TRUE(i[2] == (zson_int64)((zson_uint64)-1 >> 1));
+    zson_set_string(zson_pushback_array_element(&v), "x", 1);
+    json = zson_stringify(&v, &length);
+    EXPECT_EQ_STRING("[1,-2,9223372036854775807,\"x\"]", json, length);
+    free(json);
+    EXPECT_FALSE(zson_pack_array(&v));
+    zson_free(&v);
+
+    EXPECT_EQ_INT(ZSON_PARSE_OK, zson_parse_ex(&v, "[1,2.5]", &opt));
+    EXPECT_FALSE(zson_get_number_array(&v, &d, &n));
+    EXPECT_FALSE(zson_get_int64_array(&v, &i, &n));
+    zson_free(&v);
+    zson_free(&w);
+}
+
 static void test_access_object() {
-#if 0
     zson_value o, v, *pv;
     size_t i, j, index;
 
@@ -695,15 +2106,17 @@ static void test_access_object() {
     EXPECT_EQ_SIZE_T(0, zson_get_object_capacity(&o));
 
     zson_free(&o);
-#endif
 }
 
 static void test_access() {
     test_access_null();
     test_access_boolean();
     test_access_number();
+    test_access_special_number();
+    test_access_integer();
     test_access_string();
     test_access_array();
+    test_access_packed_array();
     test_access_object();
 }
 
@@ -715,8 +2128,19 @@ int main() {
     test_stringify();
     test_equal();
     test_copy();
+    test_copy_on_write();
+    test_freeze();
+    test_compact();
+    test_table();
+    test_tape();
+    test_reader();
     test_move();
     test_swap();
+    test_deep_nesting();
+    test_allocator();
+    test_memory_usage();
+    test_trace();
+    test_struct();
     test_access();
     printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
     return main_ret;